@@ -21,7 +21,6 @@
   * limitations under the License.
   */
 #include <xpd_pwr.h>
-#include <xpd_systick.h>
 
 #include <bsp_adc.h>
 #include <bsp_system.h>
@@ -29,53 +28,53 @@
 #include <bsp_usb.h>
 
 #include <analog.h>
+#include <scheduler.h>
 #include <usb_device.h>
 
 #include <chrg_if.h>
 #include <sens_if.h>
 #include <vcp_if.h>
 
-VCP_HandleType vcp_usart2;
+VCP_HandleType vcp_usart2, *const vcp_handle = &vcp_usart2;
 USART_HandleType *const vcp_uart = &vcp_usart2.Uart;
 USBD_CDC_IfHandleType *const vcp_if = &vcp_usart2.CdcIf;
 
-/* Lightweight periodic scheduler */
-void SysTick_Handler(void)
+void USART2_IRQHandler(void);
+
+/* VCP UART events */
+void USART2_IRQHandler(void)
 {
-    {
-        VCP_Periodic(&vcp_usart2);
-        Sensor_Periodic();
-        Charger_Periodic();
-    }
+    VCP_IRQHandler(&vcp_usart2);
 }
 
 /* Initialize the system then enter Sleep
- * and let interrupts handle everything */
+ * and let interrupts and the scheduler handle everything */
 int main(void)
 {
     /* Initialize BSP variables */
     BSP_ADC_Bind();
     BSP_VCP_UART_Bind();
     BSP_USB_Bind();
+    BSP_Sched_Bind();
 
     /* Configure system clocks */
     SystemClock_Config();
 
     {
+        /* Start the time base of the modules */
+        Sched_Init();
+
         /* Initialize basic functional blocks */
         Analog_Init();
         Charger_Init();
 
-        /* Enable periodic timer interrupts */
-        SysTick_IT_Enable();
-
         /* Enable USB device */
         UsbDevice_Init();
     }
 
     while (1)
     {
-        /* Sleep here, DMA and interrupts handle everything */
-        __WFI();
+        /* Sleep here until the next event or timer deadline */
+        Sched_Idle();
     }
 }
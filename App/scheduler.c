@@ -0,0 +1,350 @@
+/**
+  ******************************************************************************
+  * @file    scheduler.c
+  * @author  Benedek Kupper
+  * @version 1.0
+  * @date    2026-10-16
+  * @brief   DebugDongle deferred work scheduler
+  *
+  *  @verbatim
+  *
+  * ===================================================================
+  *                       Deferred work scheduler
+  * ===================================================================
+  *  The scheduler replaces the periodic polling of the modules:
+  *  software timers are registered with their deadlines, and work items
+  *  are submitted by events. Both are executed in the PendSV exception
+  *  at the lowest interrupt priority, so interrupt handlers can defer
+  *  their processing at any priority.
+  *
+  *  The time base is a free running 32-bit timer with 1 us resolution,
+  *  its compare channel is only armed for the earliest timer deadline.
+  *  The deadlines are compared wrap-safe, which limits the timer delays
+  *  and periods to half of the time base range, about 35 minutes.
+  *  Between the events the core stays in sleep, the number of wakeups
+  *  is counted to verify the idle behavior.
+  *  @endverbatim
+  *
+  * Copyright (c) 2026 Benedek Kupper
+  *
+  * Licensed under the Apache License, Version 2.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  *     http://www.apache.org/licenses/LICENSE-2.0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  */
+#include <scheduler.h>
+#include <bsp_system.h>
+#include <xpd_nvic.h>
+#include <stdbool.h>
+
+/* Wrap-safe check of a deadline */
+#define SCHED_EXPIRED(EXPIRY, NOW)  ((int32_t)((EXPIRY) - (NOW)) <= 0)
+
+void PendSV_Handler(void);
+void SCHED_TIMER_IRQHandler(void);
+
+Sched_StatsType Sched_Stats;
+
+/* Active timers in the order of expiry */
+static Sched_TimerType *timers = NULL;
+
+/* Submitted work items in the order of submission */
+static Sched_WorkType *worksHead = NULL, *worksTail = NULL;
+
+/**
+ * @brief Requests the execution of the scheduler context.
+ */
+static void Sched_Trigger(void)
+{
+    SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+}
+
+/**
+ * @brief Inserts a timer into the ordered list of active timers.
+ *        Must be called with interrupts disabled.
+ * @param Timer: the timer to insert
+ */
+static void Sched_TimerInsert(Sched_TimerType * Timer)
+{
+    Sched_TimerType **pos = &timers;
+
+    while ((*pos != NULL) && SCHED_EXPIRED((*pos)->Expiry_us, Timer->Expiry_us))
+    {
+        pos = &(*pos)->Next;
+    }
+    Timer->Next = *pos;
+    *pos = Timer;
+    Timer->Active = 1;
+}
+
+/**
+ * @brief Removes a timer from the list of active timers.
+ *        Must be called with interrupts disabled.
+ * @param Timer: the timer to remove
+ */
+static void Sched_TimerRemove(Sched_TimerType * Timer)
+{
+    Sched_TimerType **pos = &timers;
+
+    while ((*pos != NULL) && (*pos != Timer))
+    {
+        pos = &(*pos)->Next;
+    }
+    if (*pos != NULL)
+    {
+        *pos = Timer->Next;
+    }
+    Timer->Active = 0;
+}
+
+/**
+ * @brief Arms the compare channel for the earliest deadline.
+ *        Must be called with interrupts disabled.
+ * @return true if the earliest deadline has already passed
+ */
+static bool Sched_TimerArm(void)
+{
+    if (timers == NULL)
+    {
+        TIM_IT_DISABLE(sched_tim, CC1);
+        return false;
+    }
+
+    sched_tim->Inst->CCR1.w = timers->Expiry_us;
+    TIM_FLAG_CLEAR(sched_tim, CC1);
+    TIM_IT_ENABLE(sched_tim, CC1);
+
+    /* The compare event is missed if the counter has already passed it */
+    return SCHED_EXPIRED(timers->Expiry_us, Sched_GetTime_us());
+}
+
+/**
+ * @brief Removes the earliest timer if it has expired, and reloads it
+ *        if it's periodic. Otherwise arms the compare for the next deadline.
+ * @return The expired timer, or NULL if none
+ */
+static Sched_TimerType * Sched_TimerPopExpired(void)
+{
+    Sched_TimerType *timer = NULL;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    do
+    {
+        if ((timers != NULL) && SCHED_EXPIRED(timers->Expiry_us, Sched_GetTime_us()))
+        {
+            timer = timers;
+            timers = timer->Next;
+            timer->Active = 0;
+
+            if (timer->Period_us != 0)
+            {
+                timer->Expiry_us += timer->Period_us;
+
+                /* Missed periods are skipped */
+                if (SCHED_EXPIRED(timer->Expiry_us, Sched_GetTime_us()))
+                {
+                    timer->Expiry_us = Sched_GetTime_us() + timer->Period_us;
+                }
+                Sched_TimerInsert(timer);
+            }
+            break;
+        }
+    }
+    while (Sched_TimerArm());
+
+    __set_PRIMASK(primask);
+    return timer;
+}
+
+/**
+ * @brief Removes the oldest submitted work item.
+ * @return The work item, or NULL if none
+ */
+static Sched_WorkType * Sched_WorkPop(void)
+{
+    Sched_WorkType *work;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    work = worksHead;
+    if (work != NULL)
+    {
+        worksHead = work->Next;
+        if (worksHead == NULL)
+        {
+            worksTail = NULL;
+        }
+        work->Pending = 0;
+    }
+
+    __set_PRIMASK(primask);
+    return work;
+}
+
+/**
+ * @brief Initializes the time base of the scheduler.
+ */
+void Sched_Init(void)
+{
+    TIM_InitType stp = {
+        .Mode       = TIM_COUNTER_UP,
+        .Period     = 0xFFFFFFFF,
+    };
+    /* clock at 1 MHz, free running on the full 32-bit range */
+    stp.Prescaler   = TIM_ulClockFreq_Hz(sched_tim) / 1000000;
+
+    TIM_vCounterInit(sched_tim, &stp);
+    sched_tim->Inst->ARR.w = 0xFFFFFFFF;
+
+    /* The scheduler context is preempted by all peripheral interrupts */
+    NVIC_SetPriorityConfig(PendSV_IRQn, 0, 3);
+    NVIC_SetPriorityConfig(SCHED_TIMER_IRQn, 0, 3);
+    NVIC_EnableIRQ(SCHED_TIMER_IRQn);
+
+    TIM_vCounterStart(sched_tim);
+}
+
+/**
+ * @brief Puts the core to sleep until the next interrupt.
+ */
+void Sched_Idle(void)
+{
+    __WFI();
+    Sched_Stats.Wakeups++;
+}
+
+/**
+ * @brief Returns the current value of the time base.
+ * @return The time base in us, wraps around at 32 bits
+ */
+uint32_t Sched_GetTime_us(void)
+{
+    return sched_tim->Inst->CNT.w;
+}
+
+/**
+ * @brief Starts or restarts a software timer.
+ *        The times are limited to @ref SCHED_MAX_DELAY_ms.
+ * @param Timer: the timer with the callback set
+ * @param Delay_ms: time until the first expiry
+ * @param Period_ms: time between subsequent expiries, 0 for one-shot
+ */
+void Sched_TimerStart(Sched_TimerType * Timer, uint32_t Delay_ms, uint32_t Period_ms)
+{
+    uint32_t primask;
+
+    if (Delay_ms > SCHED_MAX_DELAY_ms)
+    {
+        Delay_ms = SCHED_MAX_DELAY_ms;
+    }
+    if (Period_ms > SCHED_MAX_DELAY_ms)
+    {
+        Period_ms = SCHED_MAX_DELAY_ms;
+    }
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    if (Timer->Active != 0)
+    {
+        Sched_TimerRemove(Timer);
+    }
+    Timer->Expiry_us = Sched_GetTime_us() + Delay_ms * 1000;
+    Timer->Period_us = Period_ms * 1000;
+    Sched_TimerInsert(Timer);
+
+    /* Only a new earliest deadline changes the compare */
+    if ((timers == Timer) && Sched_TimerArm())
+    {
+        Sched_Trigger();
+    }
+
+    __set_PRIMASK(primask);
+}
+
+/**
+ * @brief Stops a software timer.
+ * @param Timer: the timer to stop
+ */
+void Sched_TimerStop(Sched_TimerType * Timer)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    if (Timer->Active != 0)
+    {
+        Sched_TimerRemove(Timer);
+
+        if (Sched_TimerArm())
+        {
+            Sched_Trigger();
+        }
+    }
+
+    __set_PRIMASK(primask);
+}
+
+/**
+ * @brief Submits a work item for execution in the scheduler context.
+ *        A work item that is already pending is executed only once.
+ * @param Work: the work item with the callback set
+ */
+void Sched_WorkSubmit(Sched_WorkType * Work)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    if (Work->Pending == 0)
+    {
+        Work->Pending = 1;
+        Work->Next = NULL;
+        if (worksTail != NULL)
+        {
+            worksTail->Next = Work;
+        }
+        else
+        {
+            worksHead = Work;
+        }
+        worksTail = Work;
+    }
+
+    __set_PRIMASK(primask);
+    Sched_Trigger();
+}
+
+/* Timer deadline event */
+void SCHED_TIMER_IRQHandler(void)
+{
+    TIM_FLAG_CLEAR(sched_tim, CC1);
+    Sched_Trigger();
+}
+
+/* Scheduler context */
+void PendSV_Handler(void)
+{
+    Sched_WorkType *work;
+    Sched_TimerType *timer;
+
+    /* Execute the submitted work items */
+    while ((work = Sched_WorkPop()) != NULL)
+    {
+        Sched_Stats.Works++;
+        work->Callback(work->Arg);
+    }
+
+    /* Execute the expired timers, arm the next deadline */
+    while ((timer = Sched_TimerPopExpired()) != NULL)
+    {
+        Sched_Stats.Timers++;
+        timer->Callback(timer->Arg);
+    }
+}
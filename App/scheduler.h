@@ -0,0 +1,78 @@
+/**
+  ******************************************************************************
+  * @file    scheduler.h
+  * @author  Benedek Kupper
+  * @version 1.0
+  * @date    2026-10-16
+  * @brief   DebugDongle deferred work scheduler
+  *
+  * Copyright (c) 2026 Benedek Kupper
+  *
+  * Licensed under the Apache License, Version 2.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  *     http://www.apache.org/licenses/LICENSE-2.0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  */
+#ifndef __SCHEDULER_H_
+#define __SCHEDULER_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+
+/* The longest timer delay and period, the deadlines of the 32-bit
+ * microsecond time base are compared within half of its range */
+#define SCHED_MAX_DELAY_ms      (INT32_MAX / 1000)
+
+/** @brief Software timer, its callback is executed in the scheduler context */
+typedef struct _Sched_TimerType
+{
+    struct _Sched_TimerType *Next;
+    void (*Callback)(void * arg);
+    void *Arg;
+    uint32_t Expiry_us;     /* Time base value of the next expiry */
+    uint32_t Period_us;     /* Reload period, 0 for one-shot timers */
+    uint8_t Active;
+}Sched_TimerType;
+
+/** @brief Deferred work item, its callback is executed in the scheduler context */
+typedef struct _Sched_WorkType
+{
+    struct _Sched_WorkType *Next;
+    void (*Callback)(void * arg);
+    void *Arg;
+    volatile uint8_t Pending;
+}Sched_WorkType;
+
+/** @brief Scheduler activity counters */
+typedef struct {
+    uint32_t Wakeups;       /* Exits from sleep */
+    uint32_t Timers;        /* Timer expiries */
+    uint32_t Works;         /* Executed work items */
+}Sched_StatsType;
+
+extern Sched_StatsType Sched_Stats;
+
+void Sched_Init(void);
+void Sched_Idle(void);
+uint32_t Sched_GetTime_us(void);
+
+void Sched_TimerStart(Sched_TimerType * Timer, uint32_t Delay_ms, uint32_t Period_ms);
+void Sched_TimerStop(Sched_TimerType * Timer);
+void Sched_WorkSubmit(Sched_WorkType * Work);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SCHEDULER_H_ */
@@ -26,6 +26,7 @@
 #include <vcp_if.h>
 #include <chrg_if.h>
 #include <sens_if.h>
+#include <diag_if.h>
 
 #include <usbd_dfu.h>
 /* DFU interface is initialized by bootloader */
@@ -115,6 +116,8 @@ void UsbDevice_Init(void)
 
             sens_if->Config.InEpNum = 0x83;
 
+            diag_if->Config.InEpNum = 0x84;
+
             USBD_DFU_AppInit(dfu_if, 250); /* Detach can be carried out within 250 ms */
 
             /* Mount the interfaces to the device */
@@ -122,6 +125,7 @@ void UsbDevice_Init(void)
             USBD_CDC_MountInterface(vcp_if, UsbDevice);
             USBD_HID_MountInterface(chrg_if, UsbDevice);
             USBD_HID_MountInterface(sens_if, UsbDevice);
+            USBD_HID_MountInterface(diag_if, UsbDevice);
 
             UsbDevice->Callbacks.Suspend = usbSuspendCallback;
             UsbDevice->Callbacks.Resume = usbResumeCallback;
@@ -58,12 +58,17 @@ static void adcinit(void * handle)
 
     NVIC_SetPriorityConfig(DMA1_Channel1_IRQn, 0, 3);
     NVIC_EnableIRQ(DMA1_Channel1_IRQn);
+
+    /* Analog watchdog trips the output without delay */
+    NVIC_SetPriorityConfig(ADC1_IRQn, 0, 0);
+    NVIC_EnableIRQ(ADC1_IRQn);
 }
 
 static void adcdeinit(void * handle)
 {
     DMA_vDeinit(dmaadc);
     NVIC_DisableIRQ(DMA1_Channel1_IRQn);
+    NVIC_DisableIRQ(ADC1_IRQn);
 }
 
 void DMA1_Channel1_IRQHandler(void);
@@ -73,6 +78,13 @@ void DMA1_Channel1_IRQHandler(void)
     DMA_vIRQHandler(dmaadc);
 }
 
+void ADC1_IRQHandler(void);
+
+void ADC1_IRQHandler(void)
+{
+    ADC_vIRQHandler(adc);
+}
+
 void BSP_ADC_Bind(void)
 {
     ADC_INST2HANDLE(adc, ADC1);
@@ -34,6 +34,9 @@ extern "C"
 
 #define ADC_TRIGGER_SRC     ADC_TRIGGER_TIM3_TRGO
 
+/* ADC kernel clock: PCLK (48 MHz) / 4 */
+#define ADC_CLOCK_HZ        12000000
+
 extern ADC_HandleType *const adc;
 
 void BSP_ADC_Bind(void);
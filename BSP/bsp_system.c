@@ -25,6 +25,9 @@
 
 #include <bsp_system.h>
 
+static TIM_HandleType hsched_tim;
+TIM_HandleType *const sched_tim = &hsched_tim;
+
 static const CRS_InitType crsSetup = {
     .Source     = CRS_SYNC_SOURCE_USB,
     .ErrorLimit = CRS_ERRORLIMIT_DEFAULT,
@@ -42,3 +45,8 @@ void SystemClock_Config(void)
 
     RCC_vPCLK1_Config(CLK_DIV1);
 }
+
+void BSP_Sched_Bind(void)
+{
+    TIM_INST2HANDLE(sched_tim, TIM2);
+}
@@ -28,8 +28,19 @@ extern "C"
 {
 #endif
 
+#include <xpd_tim.h>
+
+/* 32-bit timer providing the time base of the scheduler */
+#define SCHED_TIMER_IRQn        TIM2_IRQn
+#define SCHED_TIMER_IRQHandler  TIM2_IRQHandler
+
+extern TIM_HandleType *const sched_tim;
+
 void SystemClock_Config(void);
 
+/* Needs to be called prior to using handle */
+void BSP_Sched_Bind(void);
+
 #ifdef __cplusplus
 }
 #endif
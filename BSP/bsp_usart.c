@@ -58,6 +58,8 @@ static void BSP_VCP_UART_Init(void * handle)
     /* Interrupt lines configuration */
     NVIC_SetPriorityConfig(DMA1_Channel4_5_IRQn, 0, 0);
     NVIC_EnableIRQ(DMA1_Channel4_5_IRQn);
+    NVIC_SetPriorityConfig(VCP_UART_IRQn, 0, 0);
+    NVIC_EnableIRQ(VCP_UART_IRQn);
 }
 
 /* UART dependencies deinitialization */
@@ -69,6 +71,7 @@ static void BSP_VCP_UART_Deinit(void * handle)
     DMA_vDeinit(&dmauat);
     DMA_vDeinit(&dmauar);
     NVIC_DisableIRQ(DMA1_Channel4_5_IRQn);
+    NVIC_DisableIRQ(VCP_UART_IRQn);
 }
 
 /* UART DMA interrupt handling */
@@ -32,6 +32,9 @@ extern "C"
 
 extern USART_HandleType *const vcp_uart;
 
+/* The interrupt line of the VCP UART, also used as software trigger */
+#define VCP_UART_IRQn       USART2_IRQn
+
 /* Needs to be called prior to using handle */
 void BSP_VCP_UART_Bind(void);
 
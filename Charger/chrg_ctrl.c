@@ -21,6 +21,7 @@
   * limitations under the License.
   */
 #include <chrg_ctrl.h>
+#include <efuse.h>
 #include <bsp_io.h>
 
 static ChargeCurrentType currentLimit = Ichg_100mA;
@@ -28,6 +29,20 @@ static ChargeCurrentType currentConfig = Ichg_0mA;
 
 static void Charger_onSwitchChange(uint32_t x);
 
+#if (HW_REV > 0xA)
+static uint16_t outputTrip_mA = OUTPUT_TRIP_DEFAULT_mA;
+static volatile bool outputFault = false;
+static Sched_WorkType *outputFaultWork = NULL;
+
+static void Output_onTrip(void);
+static void Output_TripHandler(void * arg);
+static Sched_WorkType outputTripWork = {
+    .Callback = Output_TripHandler,
+};
+static void Output_onCurrent(uint32_t Current_mA);
+static void Output_UpdateMeter(void);
+#endif
+
 /**
  * @brief Initializes the hardware control of the battery charger IC.
  */
@@ -53,6 +68,10 @@ void Charger_Init(void)
     /* Vout default: input */
     GPIO_vInitPin (VOUT_SELECT_PIN, VOUT_SELECT_IN_CFG);
     *GPIO_pxPinCallback(VOUT_SELECT_PIN) = Charger_onSwitchChange;
+
+    /* Output current is monitored whenever it is measured */
+    Analog_SetIoutLimit(outputTrip_mA, Output_onTrip);
+    Analog_SetIoutMonitor(Output_onCurrent);
 #else
     GPIO_vInitPin (VOUT_SELECT_PIN, VOUT_SELECT_OUT_CFG);
 
@@ -74,6 +93,7 @@ static void Charger_onSwitchChange(uint32_t x)
 {
 #if (HW_REV > 0xA)
     GPIO_vWritePin(USER_LED_PIN, GPIO_eReadPin(VOUT_SELECT_PIN));
+    Output_UpdateMeter();
 #else
     Output_SetVoltage(1 - GPIO_eReadPin(MODE_SWITCH_PIN));
 #endif
@@ -81,9 +101,10 @@ static void Charger_onSwitchChange(uint32_t x)
 
 /**
  * @brief Returns the measured battery charge current.
+ * @param Values: the analog measurements
  * @return The charge current in mA
  */
-int Charger_GetCurrent_mA(void)
+int Charger_GetCurrent_mA(const AnalogMeasurementsType * Values)
 {
     if (GPIO_eReadPin(CHARGER_STATUS_PIN) != 0)
     {
@@ -92,22 +113,23 @@ int Charger_GetCurrent_mA(void)
     }
     else
     {
-        return Analog_GetValues()->Ichrg_mA;
+        return Values->Ichrg_mA;
     }
 }
 
 /**
  * @brief Returns the measured battery (charge) voltage.
+ * @param Values: the analog measurements
  * @return The battery voltage in mV
  */
-int Charger_GetVoltage_mV(void)
+int Charger_GetVoltage_mV(const AnalogMeasurementsType * Values)
 {
-    return Analog_GetValues()->Vbat_mV;
+    return Values->Vbat_mV;
 }
 
 /**
  * @brief Handles the activation of the charger USB interface:
- *         - Enables analog conversions
+ *         - Enables analog conversions of the battery channels
  *         - Disables the switch control of the Output voltage
  */
 void Charger_SetConfig(void)
@@ -116,7 +138,8 @@ void Charger_SetConfig(void)
     {
         currentLimit = Ichg_500mA;
     }
-    Analog_Resume();
+    Analog_SetChannels(ANALOG_USER_CHARGER,
+            ADCH_MASK(ADCH_VBAT) | ADCH_MASK(ADCH_ICHARGE) | ADCH_MASK(ADCH_TEMP));
 #if (HW_REV == 0xA)
     NVIC_DisableIRQ(IRQN(VOUT_SELECT));
 #endif
@@ -124,15 +147,21 @@ void Charger_SetConfig(void)
 
 /**
  * @brief Handles the deactivation of the charger USB interface:
- *         - Disables analog conversions
+ *         - Disables analog conversions, unless the Output protection uses them
  *         - Disables the switch control of the Output voltage
  */
 void Charger_ClearConfig(void)
 {
-    Analog_Halt();
+    Analog_SetChannels(ANALOG_USER_CHARGER, 0);
 #if (HW_REV > 0xA)
-    Analog_IoutConfig(ENABLE);
-    GPIO_vInitPin (VOUT_SELECT_PIN, VOUT_SELECT_IN_CFG);
+    /* A tripped output stays off until it is explicitly switched on */
+    if (!outputFault)
+    {
+        /* The conversions keep running for the current protection */
+        Analog_IoutConfig(ENABLE);
+        GPIO_vInitPin (VOUT_SELECT_PIN, VOUT_SELECT_IN_CFG);
+        Output_UpdateMeter();
+    }
 #endif
     NVIC_EnableIRQ(IRQN(VOUT_SELECT));
 }
@@ -210,6 +239,9 @@ void Output_SetVoltage(OutputVoltageType Voltage)
 
     if (Voltage != Vout_off)
     {
+        outputFault = false;
+        Efuse_Restart();
+        Analog_CaptureTrigger();
         GPIO_vWritePin(IOUT_PIN, 0);
         Analog_IoutConfig(ENABLE);
         GPIO_vWritePin(USER_LED_PIN, 2 - Voltage);
@@ -218,11 +250,14 @@ void Output_SetVoltage(OutputVoltageType Voltage)
     }
     else
     {
+        /* Disarm the watchdog before the cut output drives the
+         * current measurement pin high */
         Analog_IoutConfig(DISABLE);
-        GPIO_vWritePin(USER_LED_PIN, 1);
-        GPIO_vInitPin (IOUT_PIN, IOUT_CTRL_CFG);
         GPIO_vWritePin(IOUT_PIN, 1);
+        GPIO_vInitPin (IOUT_PIN, IOUT_CTRL_CFG);
+        GPIO_vWritePin(USER_LED_PIN, 1);
     }
+    Output_UpdateMeter();
 #else
     GPIO_vWritePin(USER_LED_PIN, 1 - Voltage);
     GPIO_vWritePin(VOUT_SELECT_PIN, Voltage);
@@ -280,3 +315,123 @@ void Charger_Resume(void)
     Charger_SetCurrent(currentConfig);
     Charger_SetConfig();
 }
+
+#if (HW_REV > 0xA)
+/**
+ * @brief Cuts the Output when its current limit is exceeded.
+ *        Called from the ADC interrupts, the rest of the switch off
+ *        is completed in the scheduler context.
+ */
+static void Output_onTrip(void)
+{
+    if (outputFault)
+    {
+        return;
+    }
+    outputFault = true;
+
+    /* The watchdog and the metering must ignore the driven pin */
+    Analog_IoutDisarm();
+    GPIO_vWritePin(IOUT_PIN, 1);
+    GPIO_vInitPin (IOUT_PIN, IOUT_CTRL_CFG);
+
+    Sched_WorkSubmit(&outputTripWork);
+}
+
+/**
+ * @brief Completes the switch off of the tripped Output,
+ *        and notifies about the fault.
+ * @param arg: unused
+ */
+static void Output_TripHandler(void * arg)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    /* Unless the Output has been switched on again since */
+    if (outputFault)
+    {
+        GPIO_vWritePin(USER_LED_PIN, 1);
+        Analog_IoutConfig(DISABLE);
+    }
+    __set_PRIMASK(primask);
+
+    if (outputFaultWork != NULL)
+    {
+        Sched_WorkSubmit(outputFaultWork);
+    }
+}
+
+/**
+ * @brief Provides the current Output voltage to the energy metering.
+ */
+static void Output_UpdateMeter(void)
+{
+    switch (Output_GetVoltage())
+    {
+        case Vout_5V:
+            Analog_SetOutputVoltage(OUTPUT_5V_mV);
+            break;
+        case Vout_3V3:
+            Analog_SetOutputVoltage(ANALOG_VOUT_VDDA);
+            break;
+        default:
+            Analog_SetOutputVoltage(0);
+            break;
+    }
+}
+
+/**
+ * @brief Feeds the I2t protection with the Output current samples.
+ *        Called from the ADC interrupt.
+ * @param Current_mA: the sampled Output current
+ */
+static void Output_onCurrent(uint32_t Current_mA)
+{
+    /* The switched off output drives the current measurement pin
+     * until it is removed from the scan */
+    if ((GPIO_eReadPin(IOUT_PIN) == 0) &&
+        Efuse_Sample(Current_mA, Analog_GetScanRate_Hz()))
+    {
+        Output_onTrip();
+    }
+}
+
+/**
+ * @brief Sets the current limit of the Output.
+ * @param Current_mA: the trip current, 0 to disable the protection
+ */
+void Output_SetTripCurrent(uint16_t Current_mA)
+{
+    outputTrip_mA = Current_mA;
+    Analog_SetIoutLimit(Current_mA, Output_onTrip);
+}
+
+/**
+ * @brief Returns the current limit of the Output.
+ * @return The trip current in mA
+ */
+uint16_t Output_GetTripCurrent(void)
+{
+    return outputTrip_mA;
+}
+
+/**
+ * @brief Determines if the Output has been switched off by overcurrent.
+ *        The fault is cleared when the Output is switched on again.
+ * @return true if the Output is tripped
+ */
+bool Output_Overloaded(void)
+{
+    return outputFault;
+}
+
+/**
+ * @brief Sets the work item to submit when the Output is tripped.
+ * @param Work: the work item, or NULL to disable the notification
+ */
+void Output_SetFaultNotification(Sched_WorkType * Work)
+{
+    outputFaultWork = Work;
+}
+#endif
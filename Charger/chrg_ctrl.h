@@ -48,18 +48,36 @@ typedef enum
     Vout_5V,
 }OutputVoltageType;
 
+#if (HW_REV > 0xA)
+/* Default current limit of the Output */
+#ifndef OUTPUT_TRIP_DEFAULT_mA
+#define OUTPUT_TRIP_DEFAULT_mA      500
+#endif
+
+/* Nominal voltage of the 5V Output (USB supply) */
+#ifndef OUTPUT_5V_mV
+#define OUTPUT_5V_mV                5000
+#endif
+#endif
+
 void Charger_Init(void);
 void Charger_SetConfig(void);
 void Charger_ClearConfig(void);
 
-int Charger_GetCurrent_mA(void);
-int Charger_GetVoltage_mV(void);
+int Charger_GetCurrent_mA(const AnalogMeasurementsType * Values);
+int Charger_GetVoltage_mV(const AnalogMeasurementsType * Values);
 
 void Charger_SetType(USB_ChargerType UsbCharger);
 void Charger_SetCurrent(ChargeCurrentType CurrentLevel);
 
 void Output_SetVoltage(OutputVoltageType Voltage);
 OutputVoltageType Output_GetVoltage(void);
+#if (HW_REV > 0xA)
+void Output_SetTripCurrent(uint16_t Current_mA);
+uint16_t Output_GetTripCurrent(void);
+bool Output_Overloaded(void);
+void Output_SetFaultNotification(Sched_WorkType * Work);
+#endif
 
 bool Charger_UsbPowerPresent(void);
 void Charger_Suspend(void);
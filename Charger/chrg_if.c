@@ -35,11 +35,21 @@
   * limitations under the License.
   */
 #include <chrg_if.h>
+#include <scheduler.h>
 #include <hid/usage_power.h>
+#include <efuse.h>
+#include <gauge.h>
+#include <stddef.h>
+#include <string.h>
 
 #define REPORT_INTERVAL         100
 
-static const uint16_t LiCharged_mV = 4200;
+/* Number of captured samples in a feature report */
+#define CAPTURE_CHUNK           8
+
+/* Logical maximum of the metering counters, they saturate at this value */
+#define METER_MAX               0x7FFFFFFF
+
 static const uint16_t LiDischarge_mV = 2900;
 
 /** @brief HID report descriptor of chrg_if */
@@ -105,7 +115,17 @@ HID_USAGE_PAGE_POWER_DEVICE,
                 HID_LOGICAL_MIN_8(0),
                 HID_LOGICAL_MAX_8(1),
                 HID_FEATURE(Const_Arr_Abs),
-
+#if (HW_REV > 0xA)
+                /* output current limit */
+                HID_USAGE_PS_CONFIGCURRENT,
+                HID_REPORT_SIZE(16),
+                HID_REPORT_COUNT(1),
+                HID_LOGICAL_MIN_16(0),
+                HID_LOGICAL_MAX_16(1000),
+                HID_UNIT_AMPERE,
+                HID_UNIT_EXPONENT(-3),
+                HID_FEATURE(Const_Var_Abs),
+#endif
                 /* Measured output current */
                 HID_USAGE_PS_CURRENT,
                 HID_REPORT_SIZE(16),
@@ -115,6 +135,76 @@ HID_USAGE_PAGE_POWER_DEVICE,
                 HID_UNIT_AMPERE,
                 HID_UNIT_EXPONENT(-3),
                 HID_INPUT(Const_Var_Abs),
+#if (HW_REV > 0xA)
+                /* output switched off by overcurrent */
+                HID_USAGE_PS_OVERLOAD,
+                HID_REPORT_SIZE(1),
+                HID_REPORT_COUNT(1),
+                HID_LOGICAL_MIN_8(0),
+                HID_LOGICAL_MAX_8(1),
+                HID_INPUT(Const_Var_Abs | Volatile_Flag),
+
+                /* Padding */
+                HID_REPORT_SIZE(1),
+                HID_REPORT_COUNT(7),
+                HID_LOGICAL_MIN_8(0),
+                HID_LOGICAL_MAX_8(1),
+                HID_INPUT(Const_Arr_Abs),
+
+                HID_REPORT_ID(5),
+
+                /* I2t protection: nominal current */
+                HID_USAGE_PS_CONFIGCURRENT,
+                HID_REPORT_SIZE(16),
+                HID_REPORT_COUNT(1),
+                HID_LOGICAL_MIN_16(0),
+                HID_LOGICAL_MAX_16(1000),
+                HID_UNIT_AMPERE,
+                HID_UNIT_EXPONENT(-3),
+                HID_FEATURE(Const_Var_Abs),
+
+                /* time constant, inrush allowance */
+                HID_USAGE_VENDOR(0x60),
+                HID_USAGE_VENDOR(0x61),
+                HID_REPORT_SIZE(16),
+                HID_REPORT_COUNT(2),
+                HID_LOGICAL_MIN_8(0),
+                HID_LOGICAL_MAX_32(0xFFFF),
+                HID_UNIT_SECOND,
+                HID_UNIT_EXPONENT(-3),
+                HID_FEATURE(Const_Var_Abs),
+
+                HID_REPORT_ID(6),
+
+                /* Output current capture: state, trigger threshold,
+                 * chunk offset, sample count, trigger index, sample rate */
+                HID_USAGE_VENDOR(0x70),
+                HID_REPORT_SIZE(8),
+                HID_REPORT_COUNT(1),
+                HID_LOGICAL_MIN_8(0),
+                HID_LOGICAL_MAX_8(3),
+                HID_FEATURE(Data_Var_Abs),
+
+                HID_USAGE_VENDOR(0x71),
+                HID_USAGE_VENDOR(0x72),
+                HID_USAGE_VENDOR(0x73),
+                HID_USAGE_VENDOR(0x74),
+                HID_USAGE_VENDOR(0x75),
+                HID_REPORT_SIZE(16),
+                HID_REPORT_COUNT(5),
+                HID_LOGICAL_MIN_8(0),
+                HID_LOGICAL_MAX_32(0xFFFF),
+                HID_FEATURE(Data_Var_Abs),
+
+                /* Captured samples: output current and VDDA pairs,
+                 * each field is a raw value of the last usage */
+                HID_USAGE_VENDOR(0x76),
+                HID_REPORT_SIZE(16),
+                HID_REPORT_COUNT(2 * CAPTURE_CHUNK),
+                HID_LOGICAL_MIN_8(0),
+                HID_LOGICAL_MAX_32(0xFFFF),
+                HID_FEATURE(Data_Var_Abs),
+#endif
 
             ),
 
@@ -179,6 +269,16 @@ HID_USAGE_PAGE_BATTERY_SYSTEM,
                 HID_UNIT_EXPONENT(-3),
                 HID_FEATURE(Const_Var_Abs),
 
+                /* learned from complete charges, read-only */
+                HID_USAGE_BS_FULL_CHARGE_CAP,
+                HID_REPORT_SIZE(16),
+                HID_REPORT_COUNT(1),
+                HID_LOGICAL_MIN_16(0),
+                HID_LOGICAL_MAX_16(1000),
+                HID_UNIT_AMPERE_PER_SEC,
+                HID_UNIT_EXPONENT(-3),
+                HID_FEATURE(Const_Var_Abs),
+
                 HID_USAGE_BS_REMAINING_CAP,
                 HID_REPORT_SIZE(16),
                 HID_REPORT_COUNT(1),
@@ -210,6 +310,44 @@ HID_USAGE_PAGE_POWER_DEVICE,
 
         ),
 
+        HID_REPORT_ID(7),
+
+        /* Metering: reset */
+        HID_USAGE_VENDOR(0x80),
+        HID_REPORT_SIZE(8),
+        HID_REPORT_COUNT(1),
+        HID_LOGICAL_MIN_8(0),
+        HID_LOGICAL_MAX_8(1),
+        HID_FEATURE(Data_Var_Abs),
+
+        /* integration time */
+        HID_USAGE_VENDOR(0x81),
+        HID_REPORT_SIZE(32),
+        HID_REPORT_COUNT(1),
+        HID_LOGICAL_MIN_8(0),
+        HID_LOGICAL_MAX_32(METER_MAX),
+        HID_UNIT_SECOND,
+        HID_UNIT_EXPONENT(-3),
+        HID_FEATURE(Const_Var_Abs),
+#if (HW_REV > 0xA)
+        /* output charge (mC), output energy (mJ) */
+        HID_USAGE_VENDOR(0x82),
+        HID_USAGE_VENDOR(0x83),
+        HID_REPORT_SIZE(32),
+        HID_REPORT_COUNT(2),
+        HID_LOGICAL_MIN_8(0),
+        HID_LOGICAL_MAX_32(METER_MAX),
+        HID_FEATURE(Const_Var_Abs),
+#endif
+        /* battery charge (mC), battery energy (mJ) */
+        HID_USAGE_VENDOR(0x84),
+        HID_USAGE_VENDOR(0x85),
+        HID_REPORT_SIZE(32),
+        HID_REPORT_COUNT(2),
+        HID_LOGICAL_MIN_8(0),
+        HID_LOGICAL_MAX_32(METER_MAX),
+        HID_FEATURE(Const_Var_Abs),
+
     ),
 #endif /* 1 */
 };
@@ -219,6 +357,15 @@ struct {
     uint8_t id;
     struct {
         uint16_t mA;
+#if (HW_REV > 0xA)
+        union {
+            struct {
+                uint8_t overload : 1;
+                uint8_t : 7;
+            };
+            uint8_t b;
+        };
+#endif
     }output;
 }__packed vout_input __align(USBD_DATA_ALIGNMENT) = {
     .id = 2,
@@ -271,14 +418,23 @@ typedef struct {
             };
             uint8_t b;
         };
+#if (HW_REV > 0xA)
+        uint16_t trip_mA;
+#endif
     }out;
 }__packed Charger_FtOutType;
 
+/* Report #2 of the hosts that don't set the trip current */
+#define CHRG_FTOUT_MIN_LENGTH   (offsetof(Charger_FtOutType, out.b) + sizeof(uint8_t))
+
 Charger_FtOutType chrg_ftOut __align(USBD_DATA_ALIGNMENT) = {
     .id = 2,
     .out.mV = 5000,
     .out.buck = 0,
     .out.used = 1,
+#if (HW_REV > 0xA)
+    .out.trip_mA = OUTPUT_TRIP_DEFAULT_mA,
+#endif
 };
 
 /** @brief HID Feature report #3 buffer */
@@ -299,6 +455,7 @@ typedef struct {
     uint8_t id;
     struct {
         uint16_t capacity;
+        uint16_t fullcap;
     }battery;
 }__packed Charger_FtBatteryType;
 
@@ -307,25 +464,90 @@ Charger_FtBatteryType chrg_ftBatt __align(USBD_DATA_ALIGNMENT) = {
     .battery.capacity = 0,
 };
 
+#if (HW_REV > 0xA)
+/** @brief HID Feature report #5 buffer */
+typedef struct {
+    uint8_t id;
+    struct {
+        uint16_t nominal_mA;
+        uint16_t tau_ms;
+        uint16_t inrush_ms;
+    }prot;
+}__packed Charger_FtProtType;
+
+Charger_FtProtType chrg_ftProt __align(USBD_DATA_ALIGNMENT) = {
+    .id = 5,
+};
+
+/** @brief HID Feature report #6 buffer */
+typedef struct {
+    uint8_t id;
+    struct {
+        uint8_t state;              /* Set 1 to arm the capture */
+        uint16_t threshold_mA;      /* Current trigger, 0 for output enable only */
+        uint16_t offset;            /* Index of the first sample in the chunk */
+        uint16_t count;
+        uint16_t trigger;
+        uint16_t rate_Hz;
+        AnalogCaptureSampleType sample[CAPTURE_CHUNK];
+    }capture;
+}__packed Charger_FtCaptureType;
+
+Charger_FtCaptureType chrg_ftCapture __align(USBD_DATA_ALIGNMENT) = {
+    .id = 6,
+};
+#endif
+
+/** @brief HID Feature report #7 buffer */
+typedef struct {
+    uint8_t id;
+    struct {
+        uint8_t reset;              /* Set 1 to restart the integration */
+        uint32_t time_ms;
+#if (HW_REV > 0xA)
+        uint32_t out_mC;
+        uint32_t out_mJ;
+#endif
+        uint32_t chrg_mC;
+        uint32_t chrg_mJ;
+    }meter;
+}__packed Charger_FtMeterType;
+
+Charger_FtMeterType chrg_ftMeter __align(USBD_DATA_ALIGNMENT) = {
+    .id = 7,
+};
+
 const USBD_HID_ReportConfigType chrgReportConfig = {
         .Desc = ChargerReport,
         .DescLength = sizeof(ChargerReport),
-        .MaxId = 4,
+        .MaxId = 7,
         .Input.MaxSize = sizeof(chrg_input),
         .Input.Interval_ms = REPORT_INTERVAL,
-        .Feature.MaxSize = sizeof(chrg_ftOut),
+#if (HW_REV > 0xA)
+        .Feature.MaxSize = sizeof(chrg_ftCapture),
+#else
+        .Feature.MaxSize = sizeof(chrg_ftMeter),
+#endif
 };
 
 /**
  * @brief Applies the output feature report's parameters on the device.
  * @param report: the input report
+ * @param length: the length of the report
  */
-static void Charger_SetOutReport(Charger_FtOutType *report)
+static void Charger_SetOutReport(Charger_FtOutType *report, uint16_t length)
 {
     /* output voltage change:
      * 5V if voltage is higher than 4.5V
      * and Buck converter is disabled on output */
 #if (HW_REV > 0xA)
+    /* The trip current is only changed when it is present */
+    if (length >= sizeof(Charger_FtOutType))
+    {
+        Output_SetTripCurrent(report->out.trip_mA);
+        chrg_ftOut.out.trip_mA = report->out.trip_mA;
+    }
+
     if (report->out.used == 0)
     {
         Output_SetVoltage(Vout_off);
@@ -344,8 +566,11 @@ static void Charger_SetOutReport(Charger_FtOutType *report)
     }
     else
     {
+        AnalogMeasurementsType meas;
+        Analog_GetValues(&meas);
+
         Output_SetVoltage(Vout_3V3);
-        chrg_ftOut.out.mV = (uint16_t)Analog_GetValues()->Vdd_mV;
+        chrg_ftOut.out.mV = (uint16_t)meas.Vdd_mV;
         chrg_ftOut.out.buck = 1;
         chrg_ftOut.out.used = 1;
     }
@@ -386,12 +611,70 @@ static void Charger_SetChargerReport(Charger_FtChargerType *report)
  */
 static void Charger_SetBatteryReport(Charger_FtBatteryType *report)
 {
-    /* Copy input data */
-    chrg_ftBatt = *report;
+    /* The learned capacity is not writable */
+    chrg_ftBatt.battery.capacity = report->battery.capacity;
+    Gauge_SetCapacity(chrg_ftBatt.battery.capacity);
+}
+
+#if (HW_REV > 0xA)
+/**
+ * @brief Applies the output protection feature report's parameters on the device.
+ * @param report: the input report
+ */
+static void Charger_SetProtReport(Charger_FtProtType *report)
+{
+    Efuse_ConfigType config = {
+        .Nominal_mA = report->prot.nominal_mA,
+        .Tau_ms     = report->prot.tau_ms,
+        .Inrush_ms  = report->prot.inrush_ms,
+    };
+    Efuse_SetConfig(&config);
+}
+
+/**
+ * @brief Applies the capture feature report's parameters on the device.
+ * @param report: the input report
+ */
+static void Charger_SetCaptureReport(Charger_FtCaptureType *report)
+{
+    chrg_ftCapture.capture.threshold_mA = report->capture.threshold_mA;
+    chrg_ftCapture.capture.offset = report->capture.offset;
+
+    if (report->capture.state == ANALOG_CAPTURE_ARMED)
+    {
+        chrg_ftCapture.capture.rate_Hz = (uint16_t)Analog_GetScanRate_Hz();
+        Analog_CaptureArm(report->capture.threshold_mA);
+    }
+}
+#endif
+
+/**
+ * @brief Scales a total of the metering to its report field.
+ * @param total: the total in the base unit
+ * @param scale: the base units in a report unit
+ * @return The scaled total, saturated at the logical maximum
+ */
+static uint32_t Charger_MeterValue(uint64_t total, uint32_t scale)
+{
+    total /= scale;
+    return (total > METER_MAX) ? METER_MAX : (uint32_t)total;
+}
+
+/**
+ * @brief Applies the metering feature report's parameters on the device.
+ * @param report: the input report
+ */
+static void Charger_SetMeterReport(Charger_FtMeterType *report)
+{
+    if (report->meter.reset != 0)
+    {
+        Analog_ResetTotals();
+    }
 }
 
 /**
  * @brief Sets the device configuration according to the received feature report.
+ *        Reports that are shorter than their format are ignored.
  * @param itf: callback sender interface
  * @param type: report type (here always FEATURE)
  * @param data: report data
@@ -406,15 +689,47 @@ static void Charger_SetReport(void* itf, USBD_HID_ReportType type, uint8_t * dat
             break;
 
         case 2:
-            Charger_SetOutReport((Charger_FtOutType*)&data[0]);
+            if (length >= CHRG_FTOUT_MIN_LENGTH)
+            {
+                Charger_SetOutReport((Charger_FtOutType*)&data[0], length);
+            }
             break;
 
         case 3:
-            Charger_SetChargerReport((Charger_FtChargerType*)&data[0]);
+            if (length >= sizeof(Charger_FtChargerType))
+            {
+                Charger_SetChargerReport((Charger_FtChargerType*)&data[0]);
+            }
             break;
 
         case 4:
-            Charger_SetBatteryReport((Charger_FtBatteryType*)&data[0]);
+            if (length >= sizeof(Charger_FtBatteryType))
+            {
+                Charger_SetBatteryReport((Charger_FtBatteryType*)&data[0]);
+            }
+            break;
+
+#if (HW_REV > 0xA)
+        case 5:
+            if (length >= sizeof(Charger_FtProtType))
+            {
+                Charger_SetProtReport((Charger_FtProtType*)&data[0]);
+            }
+            break;
+
+        case 6:
+            if (length >= sizeof(Charger_FtCaptureType))
+            {
+                Charger_SetCaptureReport((Charger_FtCaptureType*)&data[0]);
+            }
+            break;
+#endif
+
+        case 7:
+            if (length >= sizeof(Charger_FtMeterType))
+            {
+                Charger_SetMeterReport((Charger_FtMeterType*)&data[0]);
+            }
             break;
 
         default:
@@ -427,18 +742,32 @@ static void Charger_SetReport(void* itf, USBD_HID_ReportType type, uint8_t * dat
  */
 void Charger_SendOutputReport(void)
 {
-    vout_input.output.mA = Analog_GetValues()->Iout_mA;
+    AnalogMeasurementsType meas;
+    Analog_GetValues(&meas);
+
+    vout_input.output.mA = meas.Iout_mA;
+#if (HW_REV > 0xA)
+    vout_input.output.overload = Output_Overloaded();
+#endif
     USBD_HID_ReportIn(chrg_if,
                 (uint8_t*)&vout_input, sizeof(vout_input));
 }
 
 /**
- * @brief Updates and sends IN report #4
+ * @brief Updates IN report #4 and the fuel gauge with the battery state.
+ *        Only called from the periodic report, so the gauge is updated
+ *        from a single context.
  */
-void Charger_SendBatteryReport(void)
+static void Charger_UpdateBattery(void)
 {
-    chrg_input.battery.mV = (uint16_t)Charger_GetVoltage_mV();
-    chrg_input.battery.mA = (uint16_t)Charger_GetCurrent_mA();
+    /* All decisions are made on the same measurement frame */
+    AnalogMeasurementsType meas;
+    AnalogTotalsType totals;
+    Analog_GetValues(&meas);
+    Analog_GetTotals(&totals);
+
+    chrg_input.battery.mV = (uint16_t)Charger_GetVoltage_mV(&meas);
+    chrg_input.battery.mA = (uint16_t)Charger_GetCurrent_mA(&meas);
 
     /* If charging enabled, but no current */
     if ((chrg_ftCharger.charger.mA > 0) && (chrg_input.battery.mA == 0))
@@ -468,7 +797,7 @@ void Charger_SendBatteryReport(void)
         chrg_input.battery.charged = 0;
 
         /* reduce charge current when overheated */
-        if ((Analog_GetValues()->temp_C > 50) &&
+        if ((meas.temp_C > 50) &&
             (chrg_ftCharger.charger.mA >= 500) &&
             (chrg_input.battery.mA > 300))
         {
@@ -491,20 +820,31 @@ void Charger_SendBatteryReport(void)
         }
     }
 
-    /* convert Vbat to remaining capacity */
+    /* coulomb counting with OCV and full charge corrections */
     if (chrg_input.battery.present != 0)
     {
-        /* TODO Different characteristics apply for a charged battery
-         * than a discharged */
-        {
-            /* Simple linear approximation for now */
-            int remcap = (int)chrg_ftBatt.battery.capacity *
-            ((int)chrg_input.battery.mV - (int)LiDischarge_mV) /
-            ((int)LiCharged_mV - (int)LiDischarge_mV);
+        Gauge_InputType gauge = {
+            .Vbat_mV  = chrg_input.battery.mV,
+            .Ichrg_mA = chrg_input.battery.mA,
+            .Qchrg_nC = totals.Qchrg_nC,
+            .Time_us  = totals.Time_us,
+            .Charged  = chrg_input.battery.charged,
+        };
 
-            chrg_input.battery.remcap = (uint16_t)remcap;
-        }
+        chrg_input.battery.remcap = (uint16_t)Gauge_Update(&gauge);
+        chrg_ftBatt.battery.fullcap = (uint16_t)Gauge_GetCapacity();
     }
+    else
+    {
+        Gauge_Restart();
+    }
+}
+
+/**
+ * @brief Sends IN report #4
+ */
+void Charger_SendBatteryReport(void)
+{
     USBD_HID_ReportIn(chrg_if,
                 (uint8_t*)&chrg_input, sizeof(chrg_input));
 }
@@ -544,7 +884,10 @@ static void Charger_GetReport(void* itf, USBD_HID_ReportType type, uint8_t repor
 #if (HW_REV > 0xA)
             if (conf == Vout_off)
             {
-                /* Not possible to set with switch, values are set */
+                /* Not possible to set with switch, but it can trip */
+                chrg_ftOut.out.mV = 0;
+                chrg_ftOut.out.buck = 0;
+                chrg_ftOut.out.used = 0;
             }
             else
 #endif
@@ -555,8 +898,11 @@ static void Charger_GetReport(void* itf, USBD_HID_ReportType type, uint8_t repor
             }
             else
             {
+                AnalogMeasurementsType meas;
+                Analog_GetValues(&meas);
+
                 chrg_ftOut.out.buck = 1;
-                chrg_ftOut.out.mV = (uint16_t)Analog_GetValues()->Vdd_mV;
+                chrg_ftOut.out.mV = (uint16_t)meas.Vdd_mV;
             }
 
             USBD_HID_ReportIn(itf,
@@ -578,6 +924,62 @@ static void Charger_GetReport(void* itf, USBD_HID_ReportType type, uint8_t repor
                     sizeof(chrg_ftBatt));
             break;
         }
+#if (HW_REV > 0xA)
+        case 5:
+        {
+            Efuse_ConfigType config;
+            Efuse_GetConfig(&config);
+
+            chrg_ftProt.prot.nominal_mA = config.Nominal_mA;
+            chrg_ftProt.prot.tau_ms     = config.Tau_ms;
+            chrg_ftProt.prot.inrush_ms  = config.Inrush_ms;
+
+            USBD_HID_ReportIn(itf,
+                    (uint8_t*)&chrg_ftProt,
+                    sizeof(chrg_ftProt));
+            break;
+        }
+        case 6:
+        {
+            AnalogCaptureSampleType samples[CAPTURE_CHUNK] = {{0}};
+            uint16_t count, trigger, read;
+
+            chrg_ftCapture.capture.state = Analog_CaptureStatus(&count, &trigger);
+            chrg_ftCapture.capture.count = count;
+            chrg_ftCapture.capture.trigger = trigger;
+
+            /* Consecutive reads return consecutive chunks */
+            read = Analog_CaptureRead(chrg_ftCapture.capture.offset, samples, CAPTURE_CHUNK);
+            memcpy(chrg_ftCapture.capture.sample, samples, sizeof(samples));
+
+            USBD_HID_ReportIn(itf,
+                    (uint8_t*)&chrg_ftCapture,
+                    sizeof(chrg_ftCapture));
+
+            chrg_ftCapture.capture.offset += read;
+            break;
+        }
+#endif
+        case 7:
+        {
+            /* All counters are from the same measurement frame */
+            AnalogTotalsType totals;
+            Analog_GetTotals(&totals);
+
+            /* The integration time saturates after 24.8 days */
+            chrg_ftMeter.meter.time_ms = Charger_MeterValue(totals.Time_us, 1000);
+#if (HW_REV > 0xA)
+            chrg_ftMeter.meter.out_mC  = Charger_MeterValue(totals.Qout_nC, 1000000);
+            chrg_ftMeter.meter.out_mJ  = Charger_MeterValue(totals.Eout_pJ, 1000000000);
+#endif
+            chrg_ftMeter.meter.chrg_mC = Charger_MeterValue(totals.Qchrg_nC, 1000000);
+            chrg_ftMeter.meter.chrg_mJ = Charger_MeterValue(totals.Echrg_pJ, 1000000000);
+
+            USBD_HID_ReportIn(itf,
+                    (uint8_t*)&chrg_ftMeter,
+                    sizeof(chrg_ftMeter));
+            break;
+        }
         default:
             break;
     }
@@ -585,38 +987,76 @@ static void Charger_GetReport(void* itf, USBD_HID_ReportType type, uint8_t repor
 
 /**
  * @brief Provides the input report data for transmission
+ * @param arg: unused
  */
-void Charger_Periodic(void)
+static void Charger_Report(void * arg)
 {
-    if (chrg_if->Base.Device->ConfigSelector != 0)
+    /* Send report through IN pipe */
+#if (HW_REV > 0xA)
+    static uint8_t inputsel = 0;
+    if ((inputsel++ & 1) != 0)
+    {
+        Charger_SendOutputReport();
+    }
+    else
+#endif
     {
-        static uint8_t msCounter = 0;
+        Charger_UpdateBattery();
+        Charger_SendBatteryReport();
+    }
+}
+
+static Sched_TimerType chrgTimer = {
+    .Callback = Charger_Report,
+};
 
-        if (++msCounter >= REPORT_INTERVAL)
-        {
-            /* Send report through IN pipe */
 #if (HW_REV > 0xA)
-            static uint8_t inputsel = 0;
-            if ((inputsel++ & 1) != 0)
-            {
-                Charger_SendOutputReport();
-            }
-            else
+/**
+ * @brief Reports the overcurrent trip of the output without delay.
+ * @param arg: unused
+ */
+static void Charger_OutputFault(void * arg)
+{
+    Charger_SendOutputReport();
+}
+
+static Sched_WorkType chrgFaultWork = {
+    .Callback = Charger_OutputFault,
+};
 #endif
-            {
-                Charger_SendBatteryReport();
-            }
-            msCounter = 0;
-        }
-    }
+
+/**
+ * @brief Activates the charger configuration and the periodic reports.
+ * @param itf: callback sender interface
+ */
+static void Charger_IfInit(void* itf)
+{
+    Charger_SetConfig();
+#if (HW_REV > 0xA)
+    Output_SetFaultNotification(&chrgFaultWork);
+#endif
+    Sched_TimerStart(&chrgTimer, REPORT_INTERVAL, REPORT_INTERVAL);
+}
+
+/**
+ * @brief Deactivates the charger configuration and the periodic reports.
+ * @param itf: callback sender interface
+ */
+static void Charger_IfDeinit(void* itf)
+{
+    Sched_TimerStop(&chrgTimer);
+#if (HW_REV > 0xA)
+    Output_SetFaultNotification(NULL);
+#endif
+    Charger_ClearConfig();
 }
 
 /** @brief Charger HID Application */
 const USBD_HID_AppType chrgApp =
 {
     .Name       = "Battery Charging Supervisor",
-    .Init       = (void (*)(void*))Charger_SetConfig,
-    .Deinit     = (void (*)(void*))Charger_ClearConfig,
+    .Init       = Charger_IfInit,
+    .Deinit     = Charger_IfDeinit,
     .SetReport  = Charger_SetReport,
     .GetReport  = Charger_GetReport,
     .Report     = &chrgReportConfig,
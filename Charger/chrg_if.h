@@ -33,8 +33,6 @@ extern "C"
 
 extern USBD_HID_IfHandleType *const chrg_if;
 
-void Charger_Periodic(void);
-
 #ifdef __cplusplus
 }
 #endif
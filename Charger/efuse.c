@@ -0,0 +1,149 @@
+/**
+  ******************************************************************************
+  * @file    efuse.c
+  * @author  Benedek Kupper
+  * @version 1.0
+  * @date    2026-10-16
+  * @brief   DebugDongle output I2t protection
+  *
+  *  @verbatim
+  *
+  * ===================================================================
+  *                       I2t trip curve
+  * ===================================================================
+  *  The heating of the output path is modeled as a first order system
+  *  driven by the square of the current:
+  *      H[n] = H[n-1] + I[n]^2 - H[n-1] / N,  N = Tau * Fs
+  *  which settles at N * I^2 for a constant current. The output trips
+  *  when H exceeds the level of the nominal current N * In^2, so the
+  *  time to trip from cold is Tau * ln(I^2 / (I^2 - In^2)):
+  *  a 2x overload trips after 0.29 Tau, a 1.1x overload after 1.74 Tau,
+  *  while short pulses (target inrush) only add a small amount of heat.
+  *
+  *  The decay is a multiplication with a precomputed fraction,
+  *  divisions are only done when the configuration or the sample rate
+  *  changes. The module only contains the arithmetic, it is fed with the
+  *  output current samples from the ADC interrupt.
+  *  @endverbatim
+  *
+  * Copyright (c) 2026 Benedek Kupper
+  *
+  * Licensed under the Apache License, Version 2.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  *     http://www.apache.org/licenses/LICENSE-2.0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  */
+#include <efuse.h>
+
+/* Fractional bits of the decay per sample */
+#define EFUSE_DECAY_BITS        24
+
+static Efuse_ConfigType efuseConfig = {
+    .Nominal_mA = EFUSE_NOMINAL_DEFAULT_mA,
+    .Tau_ms     = EFUSE_TAU_DEFAULT_ms,
+    .Inrush_ms  = EFUSE_INRUSH_DEFAULT_ms,
+};
+static volatile bool efuseChanged = true;
+static volatile bool efuseRestart = true;
+
+/* Model constants at the current sample rate */
+static uint32_t efuseRate_Hz = 0;
+static uint32_t efuseDecay = 0;
+static uint64_t efuseLimit = 0;
+
+/* Model state */
+static uint64_t efuseHeat = 0;
+static uint32_t efuseInrush = 0;
+
+/**
+ * @brief Calculates the model constants for a sample rate.
+ * @param Rate_Hz: the rate of the current samples
+ */
+static void efuseCompute(uint32_t Rate_Hz)
+{
+    uint32_t nominal = efuseConfig.Nominal_mA;
+    uint32_t samples = (uint32_t)efuseConfig.Tau_ms * Rate_Hz / 1000;
+
+    if (samples == 0)
+    {
+        samples = 1;
+    }
+    efuseRate_Hz = Rate_Hz;
+    efuseDecay   = (1UL << EFUSE_DECAY_BITS) / samples;
+
+    /* The settled heat of the nominal current with the rounded decay */
+    efuseLimit   = ((uint64_t)(nominal * nominal) << EFUSE_DECAY_BITS) / efuseDecay;
+}
+
+/**
+ * @brief Sets the trip curve parameters.
+ *        The new constants are applied with the next sample.
+ * @param Config: the new parameters
+ */
+void Efuse_SetConfig(const Efuse_ConfigType * Config)
+{
+    efuseConfig = *Config;
+    efuseChanged = true;
+}
+
+/**
+ * @brief Returns the trip curve parameters.
+ * @param Config: the current parameters
+ */
+void Efuse_GetConfig(Efuse_ConfigType * Config)
+{
+    *Config = efuseConfig;
+}
+
+/**
+ * @brief Restarts the model from cold with the inrush allowance,
+ *        to be called when the output is switched on.
+ */
+void Efuse_Restart(void)
+{
+    efuseRestart = true;
+}
+
+/**
+ * @brief Updates the model with a new current sample.
+ * @param Current_mA: the output current
+ * @param Rate_Hz: the rate of the current samples
+ * @return true if the output has to be tripped
+ */
+bool Efuse_Sample(uint32_t Current_mA, uint32_t Rate_Hz)
+{
+    if (efuseChanged || (Rate_Hz != efuseRate_Hz))
+    {
+        efuseChanged = false;
+        efuseCompute(Rate_Hz);
+    }
+    if (efuseRestart)
+    {
+        efuseRestart = false;
+        efuseHeat = 0;
+        efuseInrush = (uint32_t)efuseConfig.Inrush_ms * Rate_Hz / 1000;
+    }
+
+    if (efuseConfig.Nominal_mA == 0)
+    {
+        return false;
+    }
+
+    /* Split shift keeps the product in 64 bits */
+    efuseHeat += Current_mA * Current_mA;
+    efuseHeat -= ((efuseHeat >> (EFUSE_DECAY_BITS - 16)) * efuseDecay) >> 16;
+
+    if (efuseInrush > 0)
+    {
+        efuseInrush--;
+        return false;
+    }
+    return efuseHeat > efuseLimit;
+}
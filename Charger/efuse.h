@@ -0,0 +1,63 @@
+/**
+  ******************************************************************************
+  * @file    efuse.h
+  * @author  Benedek Kupper
+  * @version 1.0
+  * @date    2026-10-16
+  * @brief   DebugDongle output I2t protection
+  *
+  * Copyright (c) 2026 Benedek Kupper
+  *
+  * Licensed under the Apache License, Version 2.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  *     http://www.apache.org/licenses/LICENSE-2.0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  */
+#ifndef __EFUSE_H_
+#define __EFUSE_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Default trip curve parameters, the I2t protection is off
+ * until the host sets the nominal current of the target */
+#ifndef EFUSE_NOMINAL_DEFAULT_mA
+#define EFUSE_NOMINAL_DEFAULT_mA    0
+#endif
+#ifndef EFUSE_TAU_DEFAULT_ms
+#define EFUSE_TAU_DEFAULT_ms        1000
+#endif
+#ifndef EFUSE_INRUSH_DEFAULT_ms
+#define EFUSE_INRUSH_DEFAULT_ms     100
+#endif
+
+/** @brief Trip curve parameters */
+typedef struct
+{
+    uint16_t Nominal_mA;    /* Highest continuous current, 0 disables the protection */
+    uint16_t Tau_ms;        /* Time constant of the thermal model */
+    uint16_t Inrush_ms;     /* Time after switch-on without tripping */
+}Efuse_ConfigType;
+
+void Efuse_SetConfig(const Efuse_ConfigType * Config);
+void Efuse_GetConfig(Efuse_ConfigType * Config);
+void Efuse_Restart(void);
+bool Efuse_Sample(uint32_t Current_mA, uint32_t Rate_Hz);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __EFUSE_H_ */
@@ -0,0 +1,259 @@
+/**
+  ******************************************************************************
+  * @file    gauge.c
+  * @author  Benedek Kupper
+  * @version 1.0
+  * @date    2026-10-16
+  * @brief   DebugDongle battery fuel gauge
+  *
+  *  @verbatim
+  *
+  * ===================================================================
+  *                       Battery fuel gauge
+  * ===================================================================
+  *  The charge of the battery is counted from the integrated charge
+  *  current of the analog measurements. The discharge of the battery
+  *  is not measured, so the charge is synchronized in two points:
+  *   - After the battery has been at rest for GAUGE_REST_TIME_s, its
+  *     voltage is the open circuit voltage, which is converted to the
+  *     state of charge with a lookup table. A charged battery is only
+  *     corrected when it has been discharged below GAUGE_RELAX_SOC, the
+  *     full point is more accurate than the flat top of the table.
+  *   - When charging is complete, the battery is full.
+  *  The gauge reports no remaining capacity until the first of these.
+  *  If a charge is started from a rest point below GAUGE_LEARN_MAX_SOC
+  *  and completes, the counted charge over the charged part of the
+  *  table gives the full capacity of the battery.
+  *
+  *  The remaining capacity is the state of charge at the last
+  *  synchronization point applied on the full capacity, plus the
+  *  charge counted since. The gauge state is only accessed by the
+  *  periodic update, a new capacity is applied with the next update.
+  *  The calculations are integer-only, the 64-bit divisions are only
+  *  done in the update.
+  *  @endverbatim
+  *
+  * Copyright (c) 2026 Benedek Kupper
+  *
+  * Licensed under the Apache License, Version 2.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  *     http://www.apache.org/licenses/LICENSE-2.0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  */
+#include <gauge.h>
+
+/* Full scale of the state of charge (0.1 %) */
+#define GAUGE_SOC_FULL          1000
+
+/* Charge of 1 mAh */
+#define GAUGE_nC_PER_mAh        3600000000ULL
+
+/** @brief Open circuit voltage of a Li-ion cell at the state of charge */
+static const struct {
+    uint16_t mV;
+    uint16_t soc;
+}gaugeOcv[] =
+{
+    { 3000,    0 },
+    { 3300,   20 },
+    { 3500,   50 },
+    { 3600,  100 },
+    { 3680,  200 },
+    { 3740,  300 },
+    { 3780,  400 },
+    { 3820,  500 },
+    { 3870,  600 },
+    { 3930,  700 },
+    { 4000,  800 },
+    { 4080,  900 },
+    { 4200, 1000 },
+};
+
+#define GAUGE_OCV_COUNT         (sizeof(gaugeOcv) / sizeof(gaugeOcv[0]))
+
+static uint64_t gaugeFull_nC = 0;
+static volatile uint32_t gaugeNewCapacity_mAh = 0;
+static volatile bool gaugeCapacityChanged = false;
+
+/* The last synchronization point */
+static bool gaugeSynced = false;
+static uint16_t gaugeSyncSoc = 0;
+static uint64_t gaugeCounted_nC = 0;
+
+/* Last values of the counters */
+static uint64_t gaugeLastQ_nC = 0, gaugeLastTime_us = 0;
+static uint64_t gaugeRest_us = 0;
+static bool gaugeCharged = false;
+
+/* Full capacity learning */
+static bool gaugeLearning = false;
+static uint64_t gaugeLearn_nC;
+
+/**
+ * @brief Converts an open circuit voltage to state of charge.
+ * @param Vbat_mV: the battery voltage at rest
+ * @return The state of charge in 0.1 %
+ */
+static uint32_t gaugeOcvToSoc(uint32_t Vbat_mV)
+{
+    uint8_t i;
+
+    if (Vbat_mV <= gaugeOcv[0].mV)
+    {
+        return gaugeOcv[0].soc;
+    }
+    for (i = 1; i < GAUGE_OCV_COUNT; i++)
+    {
+        if (Vbat_mV < gaugeOcv[i].mV)
+        {
+            /* Linear interpolation between the points */
+            return gaugeOcv[i - 1].soc
+                    + (Vbat_mV - gaugeOcv[i - 1].mV) * (gaugeOcv[i].soc - gaugeOcv[i - 1].soc)
+                    / (gaugeOcv[i].mV - gaugeOcv[i - 1].mV);
+        }
+    }
+    return GAUGE_SOC_FULL;
+}
+
+/**
+ * @brief Synchronizes the charge to a known state of charge.
+ * @param Soc: the state of charge in 0.1 %
+ */
+static void gaugeSync(uint32_t Soc)
+{
+    gaugeSyncSoc = Soc;
+    gaugeCounted_nC = 0;
+    gaugeSynced = true;
+}
+
+/**
+ * @brief Returns the charge of the battery.
+ * @return The remaining charge in nC
+ */
+static uint64_t gaugeCharge_nC(void)
+{
+    return gaugeFull_nC / GAUGE_SOC_FULL * gaugeSyncSoc + gaugeCounted_nC;
+}
+
+/**
+ * @brief Discards the battery state, the gauge waits for the next
+ *        synchronization point (when a battery is inserted).
+ */
+void Gauge_Restart(void)
+{
+    gaugeSynced = false;
+    gaugeLearning = false;
+    gaugeRest_us = 0;
+}
+
+/**
+ * @brief Sets the full capacity of the battery, e.g. its design capacity.
+ *        The capacity is applied with the next update, the state of
+ *        charge is kept.
+ * @param Capacity_mAh: the full capacity
+ */
+void Gauge_SetCapacity(uint32_t Capacity_mAh)
+{
+    gaugeNewCapacity_mAh = Capacity_mAh;
+    gaugeCapacityChanged = true;
+}
+
+/**
+ * @brief Returns the full capacity of the battery, which is learned
+ *        from complete charges. Only to be called from the context
+ *        of the update.
+ * @return The full capacity in mAh
+ */
+uint32_t Gauge_GetCapacity(void)
+{
+    return (uint32_t)(gaugeFull_nC / GAUGE_nC_PER_mAh);
+}
+
+/**
+ * @brief Updates the gauge with the battery state.
+ * @param Input: the current battery state
+ * @return The remaining capacity in mAh, 0 before the first synchronization
+ */
+uint32_t Gauge_Update(const Gauge_InputType * Input)
+{
+    uint64_t dQ_nC, dt_us;
+
+    if (gaugeCapacityChanged)
+    {
+        gaugeCapacityChanged = false;
+        gaugeFull_nC = gaugeNewCapacity_mAh * GAUGE_nC_PER_mAh;
+    }
+
+    /* The counters restart when they are reset */
+    dQ_nC = Input->Qchrg_nC - ((Input->Qchrg_nC >= gaugeLastQ_nC) ? gaugeLastQ_nC : 0);
+    dt_us = Input->Time_us  - ((Input->Time_us  >= gaugeLastTime_us) ? gaugeLastTime_us : 0);
+    gaugeLastQ_nC = Input->Qchrg_nC;
+    gaugeLastTime_us = Input->Time_us;
+
+    /* Coulomb counting */
+    if (Input->Ichrg_mA > 0)
+    {
+        gaugeCounted_nC += dQ_nC;
+        gaugeRest_us = 0;
+
+        if (gaugeLearning)
+        {
+            gaugeLearn_nC += dQ_nC;
+        }
+    }
+    else
+    {
+        /* The voltage of a relaxed battery is its OCV */
+        gaugeRest_us += dt_us;
+
+        if (gaugeRest_us >= (GAUGE_REST_TIME_s * 1000000ULL))
+        {
+            uint32_t soc = gaugeOcvToSoc(Input->Vbat_mV);
+
+            if (!gaugeSynced || !Input->Charged ||
+                (gaugeCharge_nC() > gaugeFull_nC / GAUGE_SOC_FULL * (soc + GAUGE_RELAX_SOC)))
+            {
+                gaugeSync(soc);
+                gaugeLearning = (soc <= GAUGE_LEARN_MAX_SOC);
+                gaugeLearn_nC = 0;
+            }
+        }
+    }
+
+    /* The end of charge is the full point */
+    if (Input->Charged && !gaugeCharged)
+    {
+        if (gaugeLearning)
+        {
+            uint64_t full_nC = gaugeLearn_nC / (GAUGE_SOC_FULL - gaugeSyncSoc) * GAUGE_SOC_FULL;
+
+            /* Implausible results are discarded */
+            if ((gaugeFull_nC == 0) ||
+                ((full_nC > gaugeFull_nC / 2) && (full_nC < gaugeFull_nC * 3 / 2)))
+            {
+                gaugeFull_nC = full_nC;
+            }
+            gaugeLearning = false;
+        }
+        gaugeSync(GAUGE_SOC_FULL);
+    }
+    gaugeCharged = Input->Charged;
+
+    /* The charge is only known relative to the full capacity */
+    if (!gaugeSynced || (gaugeFull_nC == 0))
+    {
+        return 0;
+    }
+    if (gaugeCharge_nC() > gaugeFull_nC)
+    {
+        gaugeCounted_nC = gaugeFull_nC - gaugeFull_nC / GAUGE_SOC_FULL * gaugeSyncSoc;
+    }
+    return (uint32_t)(gaugeCharge_nC() / GAUGE_nC_PER_mAh);
+}
@@ -0,0 +1,69 @@
+/**
+  ******************************************************************************
+  * @file    gauge.h
+  * @author  Benedek Kupper
+  * @version 1.0
+  * @date    2026-10-16
+  * @brief   DebugDongle battery fuel gauge
+  *
+  * Copyright (c) 2026 Benedek Kupper
+  *
+  * Licensed under the Apache License, Version 2.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  *     http://www.apache.org/licenses/LICENSE-2.0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  */
+#ifndef __GAUGE_H_
+#define __GAUGE_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Time without current before the battery voltage is taken as OCV */
+#ifndef GAUGE_REST_TIME_s
+#define GAUGE_REST_TIME_s           600
+#endif
+
+/* Drop of the OCV state of charge of a charged battery after relaxation,
+ * which is not corrected, in 0.1 % */
+#ifndef GAUGE_RELAX_SOC
+#define GAUGE_RELAX_SOC             50
+#endif
+
+/* Highest state of charge where a full charge can be learned from, in 0.1 % */
+#ifndef GAUGE_LEARN_MAX_SOC
+#define GAUGE_LEARN_MAX_SOC         500
+#endif
+
+/** @brief Battery state for the gauge update */
+typedef struct
+{
+    uint32_t Vbat_mV;       /* Battery voltage */
+    uint32_t Ichrg_mA;      /* Charge current, 0 when not charging */
+    uint64_t Qchrg_nC;      /* Charge counter (AnalogTotalsType) */
+    uint64_t Time_us;       /* Time counter of the charge counter */
+    bool Charged;           /* Charging is complete */
+}Gauge_InputType;
+
+void Gauge_Restart(void);
+void Gauge_SetCapacity(uint32_t Capacity_mAh);
+uint32_t Gauge_GetCapacity(void);
+uint32_t Gauge_Update(const Gauge_InputType * Input);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __GAUGE_H_ */
@@ -22,6 +22,66 @@
   */
 #include <analog.h>
 #include <bsp_adc.h>
+#include <string.h>
+
+/* Rate of the measurements provided by Analog_GetValues() */
+#ifndef ANALOG_RATE_HZ
+#define ANALOG_RATE_HZ          100
+#endif
+
+/* Number of conversion sequences averaged into a measurement,
+ * each factor of 4 adds one effective bit, must be a power of 2 */
+#ifndef ANALOG_OVERSAMPLING
+#define ANALOG_OVERSAMPLING     16
+#endif
+
+/* Extra bits of the decimated samples above the 12-bit resolution */
+#if   (ANALOG_OVERSAMPLING >= 256)
+#define ANALOG_EXTRA_BITS       4
+#elif (ANALOG_OVERSAMPLING >= 64)
+#define ANALOG_EXTRA_BITS       3
+#elif (ANALOG_OVERSAMPLING >= 16)
+#define ANALOG_EXTRA_BITS       2
+#elif (ANALOG_OVERSAMPLING >= 4)
+#define ANALOG_EXTRA_BITS       1
+#else
+#define ANALOG_EXTRA_BITS       0
+#endif
+
+/* Trigger timer clock */
+#define ANALOG_TRIGGER_CLOCK_HZ 1000000
+
+/* Limits of the configurable measurement rate */
+#define ANALOG_MIN_RATE_HZ      1
+#define ANALOG_MAX_RATE_HZ      500
+
+/* Shortest sample time of the internal channels */
+#define ANALOG_MIN_SAMPLE_ns    4000
+
+/* Half ADC clock cycles of conversion besides the sample time */
+#define ANALOG_CONV_HALFCYCLES  25
+
+/* Full scale of the decimated samples */
+#define ANALOG_FULL_SCALE       (4095 << ANALOG_EXTRA_BITS)
+
+/* Factory calibration values, measured at VDDA = 3.3 V */
+#define ANALOG_CAL_VDDA_mV      3300
+#define ANALOG_TS_CAL1          (*(const uint16_t *)0x1FFFF7B8) /* at 30 C */
+#define ANALOG_VREFINT_CAL      (*(const uint16_t *)0x1FFFF7BA)
+#define ANALOG_TS_CAL2          (*(const uint16_t *)0x1FFFF7C2) /* at 110 C */
+#define ANALOG_TS_CAL1_C        30
+#define ANALOG_TS_CAL2_C        110
+
+/* Fractional bits of the channel coefficients */
+#define ANALOG_COEFF_BITS       28
+
+/* Channel coefficient of (NUM / DEN) * VDDA / full scale, without VDDA */
+#define ANALOG_COEFF(NUM, DEN)  ((uint32_t)(                            \
+        (((uint64_t)(NUM) << ANALOG_COEFF_BITS) + (uint64_t)(DEN) * ANALOG_FULL_SCALE / 2) \
+        / ((uint64_t)(DEN) * ANALOG_FULL_SCALE)))
+
+/* Fractional bits of the temperature slope */
+#define ANALOG_TEMP_BITS        16
 
 /** @brief ADC peripheral settings */
 static const ADC_InitType adcSettings =
@@ -39,89 +99,626 @@ static const ADC_InitType adcSettings =
     .LPAutoPowerOff         = ENABLE,
 };
 
-/* On STM32F0 channel order is according to the channel number */
-typedef enum
-{
-#if (HW_REV > 0xA)
-    ADCH_IOUT = 0,
-    ADCH_LIGHT_SENSOR,
-#else
-    ADCH_LIGHT_SENSOR = 0,
-#endif
-    ADCH_VBAT,
-    ADCH_ICHARGE,
-    ADCH_TEMP,
-    ADCH_VREFINT,
-    ADCH_COUNT
-}ADCHType;
-
 /** @brief ADC channels configuration */
-static const ADC_ChannelInitType adcChannels[] =
+static ADC_ChannelInitType adcChannels[ADCH_COUNT] =
 {
 #if (HW_REV > 0xA)
-    {
+    [ADCH_IOUT] = {
         .Number     = IOUT_CH,
         .SampleTime = ADC_SAMPLETIME_239p5
     },
 #endif
-    {
+    [ADCH_VBAT] = {
         .Number     = VBAT_CH,
         .SampleTime = ADC_SAMPLETIME_239p5
     },
-    {
+    [ADCH_LIGHT_SENSOR] = {
         .Number     = LIGHT_SENSOR_CH,
         .SampleTime = ADC_SAMPLETIME_239p5
     },
-    {
+    [ADCH_ICHARGE] = {
         .Number     = ICHARGE_CH,
         .SampleTime = ADC_SAMPLETIME_239p5
     },
-    {
+    [ADCH_TEMP] = {
         .Number     = ADC1_TEMPSENSOR_CHANNEL,
         .SampleTime = ADC_SAMPLETIME_239p5
     },
-    {
+    [ADCH_VREFINT] = {
         .Number     = ADC1_VREFINT_CHANNEL,
         .SampleTime = ADC_SAMPLETIME_239p5
     },
 };
 
+/** @brief Conversion coefficients of the channels, the measured VDDA
+ *         is applied once per measurement */
+static const uint32_t analogCoeffs[ADCH_COUNT] =
+{
+#if (HW_REV > 0xA)
+    /*  I = Vmeas / (R=1K * k=1/1000) */
+    [ADCH_IOUT]         = ANALOG_COEFF(1, 1),
+#endif
+    /* lx = (Vmeas / R=10K) * 500 / 300 */
+    [ADCH_LIGHT_SENSOR] = ANALOG_COEFF(5, 30),
+
+    /* Voltage divider: Vmeas = Vbat * R2=470 / (R1=130 + R2=470) */
+    [ADCH_VBAT]         = ANALOG_COEFF(130 + 470, 470),
+
+    /*  I = Vmeas * 540 / (1.5 * R=680) */
+    [ADCH_ICHARGE]      = ANALOG_COEFF(54, 102),
+
+    /* Temperature sensor sample rescaled to the calibration VDDA */
+    [ADCH_TEMP]         = ANALOG_COEFF(ANALOG_FULL_SCALE, ANALOG_CAL_VDDA_mV),
+};
+
+/* Calibration based constants */
+static uint32_t analogVddaCal;
+static int32_t analogTempCal1, analogTempSlope;
+
+/* Sample times in half ADC clock cycles */
+static const uint16_t adcSampleHalfCycles[] =
+{
+    [ADC_SAMPLETIME_1p5]    = 3,
+    [ADC_SAMPLETIME_7p5]    = 15,
+    [ADC_SAMPLETIME_13p5]   = 27,
+    [ADC_SAMPLETIME_28p5]   = 57,
+    [ADC_SAMPLETIME_41p5]   = 83,
+    [ADC_SAMPLETIME_55p5]   = 111,
+    [ADC_SAMPLETIME_71p5]   = 143,
+    [ADC_SAMPLETIME_239p5]  = 479,
+};
+
+static uint16_t analogRate_Hz = ANALOG_RATE_HZ;
+
+/* The requested sampling, applied by the rescan */
+static volatile uint16_t analogReqRate_Hz = ANALOG_RATE_HZ;
+static volatile uint8_t analogReqSampleTime = ADC_SAMPLETIME_239p5;
+static volatile bool analogRateChanged = false;
+
+static void analogRescan(void * arg);
+
+/* The scan is reconfigured in the scheduler context, where it cannot
+ * preempt the processing of the conversions */
+static Sched_WorkType analogRescanWork = {
+    .Callback = analogRescan,
+};
+
+#if (HW_REV > 0xA)
+/* Output current limit of the analog watchdog */
+static uint32_t ioutLimit_mA = 0;
+static void (*ioutTrip)(void) = NULL;
+
+/* Output current monitor, fed with each conversion sequence */
+static void (*ioutMonitor)(uint32_t Iout_mA) = NULL;
+static uint32_t ioutGain;
+
+/* Raw conversions of a sequence in the capture ring */
+typedef struct
+{
+    uint16_t Iout;
+    uint16_t Vref;
+}AnalogCaptureRawType;
+
+/* Capture ring, frozen after the trigger and the post-trigger samples */
+static AnalogCaptureRawType captureRing[ANALOG_CAPTURE_LENGTH];
+static volatile AnalogCaptureStateType captureState = ANALOG_CAPTURE_IDLE;
+static volatile bool captureArmRequest = false, captureTriggerRequest = false;
+/* Written before the arm request, so it is not reordered past it */
+static volatile uint16_t captureArmThreshold = 0;
+static uint16_t captureThreshold = 0;
+static uint16_t capturePos = 0, captureCount = 0, captureRemaining = 0;
+static uint32_t captureTotal = 0, captureTriggerSeq = 0;
+#endif
+
+/* Channels requested by each user */
+static uint32_t analogUsers[ANALOG_USER_COUNT] = {
+#if (HW_REV > 0xA)
+    /* The output is enabled by default, and it is protected
+     * from the initialization, before USB is configured */
+    [ANALOG_USER_OUTPUT] = ADCH_MASK(ADCH_IOUT),
+#endif
+};
+
+/* The scanned channels, in the order of conversion */
+static uint32_t adcScanMask = 0;
+static uint8_t adcScanCount = 0;
+static bool adcTriggered = false;
+static ADCHType adcScan[ADCH_COUNT];
+static ADC_ChannelInitType adcScanConfig[ADCH_COUNT];
+
 static uint16_t conversions[ADCH_COUNT];
-static AnalogMeasurementsType measurements;
+static uint32_t accumulators[ADCH_COUNT];
+static uint16_t samples[ADCH_COUNT];
+static uint16_t accumulatedCount = 0;
+/* Double buffered measurements, the latest is at the sequence's parity */
+static AnalogMeasurementsType measurements[2];
+static volatile uint32_t measurementSeq = 0;
+static Sched_WorkType *measuredWork = NULL;
+
+/* Integrated measurements, published together with the measurements */
+static AnalogTotalsType totals[2];
+static volatile bool totalsReset = false;
+static uint32_t analogFrame_us;
+#if (HW_REV > 0xA)
+static volatile uint32_t analogVout_mV = 0;
+#endif
+
+/**
+ * @brief Provide a consistent copy of the latest measurement results.
+ *        The copy is repeated if a new measurement was completed meanwhile,
+ *        which only happens to callers that can be preempted by the ADC.
+ * @param Values: the copy of the measured values
+ */
+void Analog_GetValues(AnalogMeasurementsType * Values)
+{
+    uint32_t seq;
+
+    do
+    {
+        seq = measurementSeq;
+        /* The copy must not be moved outside of the sequence reads */
+        __DMB();
+        *Values = measurements[seq & 1];
+        __DMB();
+    }
+    while (seq != measurementSeq);
+}
+
+/**
+ * @brief Provide a consistent copy of the integrated measurements,
+ *        which belong to the latest measurement frame.
+ * @param Totals: the copy of the integrated values
+ */
+void Analog_GetTotals(AnalogTotalsType * Totals)
+{
+    uint32_t seq;
+
+    do
+    {
+        seq = measurementSeq;
+        __DMB();
+        *Totals = totals[seq & 1];
+        __DMB();
+    }
+    while (seq != measurementSeq);
+}
 
 /**
- * @brief Provide measurement results.
- * @return reference of the measured values
+ * @brief Restarts the integrated measurements from the next frame.
  */
-const AnalogMeasurementsType * Analog_GetValues(void)
+void Analog_ResetTotals(void)
 {
-    return &measurements;
+    totalsReset = true;
 }
 
 /**
- * @brief Convert the ADC conversions into physical measurement values
- *        after the end of a conversion sequence.
+ * @brief Sets the work item to submit when new measurements are available.
+ * @param Work: the work item, or NULL to disable the notification
+ */
+void Analog_SetNotification(Sched_WorkType * Work)
+{
+    measuredWork = Work;
+}
+
+/**
+ * @brief Restarts the accumulation of the conversion sequences.
+ */
+static void analogResetAccumulators(void)
+{
+    uint8_t ch;
+
+    for (ch = 0; ch < ADCH_COUNT; ch++)
+    {
+        accumulators[ch] = 0;
+    }
+    accumulatedCount = 0;
+}
+
+/**
+ * @brief Calculates the conversion constants from the factory calibration.
+ */
+static void analogCalibrate(void)
+{
+    analogVddaCal   = (ANALOG_CAL_VDDA_mV * ANALOG_VREFINT_CAL) << ANALOG_EXTRA_BITS;
+    analogTempCal1  = ANALOG_TS_CAL1 << ANALOG_EXTRA_BITS;
+    analogTempSlope = ((ANALOG_TS_CAL2_C - ANALOG_TS_CAL1_C) << ANALOG_TEMP_BITS)
+                    / ((ANALOG_TS_CAL2 - ANALOG_TS_CAL1) * (1 << ANALOG_EXTRA_BITS));
+#if (HW_REV > 0xA)
+    ioutGain = (ANALOG_CAL_VDDA_mV * analogCoeffs[ADCH_IOUT]) >> (ANALOG_COEFF_BITS - 16);
+#endif
+}
+
+/**
+ * @brief Converts a decimated sample with its channel coefficient.
+ * @param ch: the ADC channel
+ * @param vdda_mV: the measured analog supply voltage
+ * @return The converted value
+ */
+static int32_t analogScale(ADCHType ch, uint32_t vdda_mV)
+{
+    /* Split shifts keep the products in 32 bits */
+    uint32_t gain = (vdda_mV * analogCoeffs[ch]) >> (ANALOG_COEFF_BITS - 16);
+
+    return (samples[ch] * gain) >> 16;
+}
+
+/**
+ * @brief Updates the integrated measurements with a new frame.
+ * @param next: the new measurement frame
+ */
+static void analogUpdateTotals(const AnalogMeasurementsType * next)
+{
+    AnalogTotalsType *sum = &totals[(measurementSeq + 1) & 1];
+
+    if (totalsReset)
+    {
+        totalsReset = false;
+        memset(sum, 0, sizeof(*sum));
+        return;
+    }
+    *sum = totals[measurementSeq & 1];
+    sum->Time_us += analogFrame_us;
+
+    /* mA * us = nC, mA * mV * us = pJ, the units are only scaled on reading */
+#if (HW_REV > 0xA)
+    /* Output current is only valid while the output is on */
+    if (analogVout_mV != 0)
+    {
+        uint32_t vout_mV = (analogVout_mV == ANALOG_VOUT_VDDA) ?
+                next->Vdd_mV : analogVout_mV;
+
+        sum->Qout_nC += (uint64_t)next->Iout_mA * analogFrame_us;
+        sum->Eout_pJ += (uint64_t)(next->Iout_mA * vout_mV) * analogFrame_us;
+    }
+#endif
+    sum->Qchrg_nC += (uint64_t)next->Ichrg_mA * analogFrame_us;
+    sum->Echrg_pJ += (uint64_t)(next->Ichrg_mA * next->Vbat_mV) * analogFrame_us;
+}
+
+/**
+ * @brief Convert the decimated samples into physical measurement values.
+ *        Only the VDDA calculation needs a division, the channels are
+ *        converted with multiplications and shifts.
+ */
+static void analogConvertMeasured(void)
+{
+    AnalogMeasurementsType *next = &measurements[(measurementSeq + 1) & 1];
+    uint32_t vdda_mV;
+
+    if (samples[ADCH_VREFINT] != 0)
+    {
+        next->Vdd_mV = analogVddaCal / samples[ADCH_VREFINT];
+    }
+    else
+    {
+        next->Vdd_mV = measurements[measurementSeq & 1].Vdd_mV;
+    }
+    vdda_mV = next->Vdd_mV;
+
+    next->temp_C   = (((analogScale(ADCH_TEMP, vdda_mV) - analogTempCal1)
+            * analogTempSlope) >> ANALOG_TEMP_BITS) + ANALOG_TS_CAL1_C;
+
+    next->Vbat_mV  = analogScale(ADCH_VBAT, vdda_mV);
+    next->Ichrg_mA = analogScale(ADCH_ICHARGE, vdda_mV);
+    next->light_lx = analogScale(ADCH_LIGHT_SENSOR, vdda_mV);
+#if (HW_REV > 0xA)
+    next->Iout_mA  = analogScale(ADCH_IOUT, vdda_mV);
+    ioutGain = (vdda_mV * analogCoeffs[ADCH_IOUT]) >> (ANALOG_COEFF_BITS - 16);
+#endif
+    analogUpdateTotals(next);
+
+    /* Publish the complete frame, after all of its writes */
+    __DMB();
+    measurementSeq++;
+
+    if (measuredWork != NULL)
+    {
+        Sched_WorkSubmit(measuredWork);
+    }
+}
+
+#if (HW_REV > 0xA)
+/**
+ * @brief Stores the raw conversions of a sequence in the capture ring,
+ *        and handles the capture trigger. The requests are applied here,
+ *        so the ring is only modified in the ADC interrupt.
+ * @param Iout: the output current conversion, 0 if not scanned
+ * @param Vref: the internal reference conversion
+ */
+static void analogCapture(uint16_t Iout, uint16_t Vref)
+{
+    if (captureArmRequest)
+    {
+        captureArmRequest = false;
+        captureTriggerRequest = false;
+        captureThreshold = captureArmThreshold;
+        capturePos = 0;
+        captureCount = 0;
+        captureTotal = 0;
+        captureState = ANALOG_CAPTURE_ARMED;
+    }
+    else if (captureState == ANALOG_CAPTURE_IDLE || captureState == ANALOG_CAPTURE_DONE)
+    {
+        captureTriggerRequest = false;
+        return;
+    }
+
+    captureRing[capturePos].Iout = Iout;
+    captureRing[capturePos].Vref = Vref;
+    capturePos = (capturePos + 1) % ANALOG_CAPTURE_LENGTH;
+    if (captureCount < ANALOG_CAPTURE_LENGTH)
+    {
+        captureCount++;
+    }
+    captureTotal++;
+
+    if (captureState == ANALOG_CAPTURE_ARMED)
+    {
+        if (captureTriggerRequest ||
+            ((captureThreshold > 0) && (Iout > captureThreshold)))
+        {
+            captureTriggerRequest = false;
+            captureTriggerSeq = captureTotal - 1;
+            captureRemaining = ANALOG_CAPTURE_LENGTH - ANALOG_CAPTURE_PRETRIGGER - 1;
+            captureState = (captureRemaining > 0) ?
+                    ANALOG_CAPTURE_TRIGGERED : ANALOG_CAPTURE_DONE;
+        }
+    }
+    else if (--captureRemaining == 0)
+    {
+        captureState = ANALOG_CAPTURE_DONE;
+    }
+}
+#endif
+
+/**
+ * @brief Accumulates the conversions after the end of a conversion sequence,
+ *        and decimates them into new measurements after the oversampling
+ *        count is reached (boxcar filter).
  * @param handle: unused
  */
-static void analogConvertMeasured(void * handle)
+static void analogAccumulate(void * handle)
 {
-    /* Internal channels converted with driver */
-    measurements.Vdd_mV   = ADC_lCalcVDDA_mV(conversions[ADCH_VREFINT]);
-    measurements.temp_C   = ADC_lCalcTemp_C(conversions[ADCH_TEMP]);
+    uint8_t ch;
+#if (HW_REV > 0xA)
+    uint16_t iout = 0, vref = 0;
+#endif
 
-    /* Voltage divider: Vmeas = Vbat * R2=470 / (R1=130 + R2=470) */
-    measurements.Vbat_mV  = ADC_lCalcExt_mV(conversions[ADCH_VBAT]) * (130 + 470) / 470;
+    for (ch = 0; ch < adcScanCount; ch++)
+    {
+        accumulators[adcScan[ch]] += conversions[ch];
 
-    /*  I = Vmeas * 540 / (1.5 * R=680) */
-    measurements.Ichrg_mA = ADC_lCalcExt_mV(conversions[ADCH_ICHARGE]) * 54 / 102;
+#if (HW_REV > 0xA)
+        if (adcScan[ch] == ADCH_IOUT)
+        {
+            iout = conversions[ch];
 
-    /* lx = (Vmeas / R=10K) * 500 / 300 */
-    measurements.light_lx = ADC_lCalcExt_mV(conversions[ADCH_LIGHT_SENSOR]) * 5 / 30;
+            /* Single conversions are scaled with the latest VDDA */
+            if (ioutMonitor != NULL)
+            {
+                ioutMonitor(((iout << ANALOG_EXTRA_BITS) * ioutGain) >> 16);
+            }
+        }
+        else if (adcScan[ch] == ADCH_VREFINT)
+        {
+            vref = conversions[ch];
+        }
+#endif
+    }
+#if (HW_REV > 0xA)
+    analogCapture(iout, vref);
+#endif
+
+    if (++accumulatedCount >= ANALOG_OVERSAMPLING)
+    {
+        /* The sum of 4^n samples has n bits of extra resolution */
+        for (ch = 0; ch < ADCH_COUNT; ch++)
+        {
+            samples[ch] = accumulators[ch] * (1 << ANALOG_EXTRA_BITS) / ANALOG_OVERSAMPLING;
+        }
+        analogResetAccumulators();
+
+        analogConvertMeasured();
+    }
+}
+
+/**
+ * @brief Returns the trigger timer period of a measurement rate.
+ * @param Rate_Hz: the measurement rate
+ * @return The period in trigger timer clocks
+ */
+static uint32_t analogTriggerPeriod(uint16_t Rate_Hz)
+{
+    return ANALOG_TRIGGER_CLOCK_HZ / ((uint32_t)Rate_Hz * ANALOG_OVERSAMPLING);
+}
+
+/**
+ * @brief Returns the exact period of the measurement frames.
+ * @param Rate_Hz: the measurement rate
+ * @return The period in us
+ */
+static uint32_t analogFramePeriod_us(uint16_t Rate_Hz)
+{
+    return analogTriggerPeriod(Rate_Hz) * ANALOG_OVERSAMPLING
+            * (1000000 / ANALOG_TRIGGER_CLOCK_HZ);
+}
+
+/**
+ * @brief Converts ADC half clock cycles to time.
+ * @param HalfCycles: the number of half ADC clock cycles
+ * @return The duration in ns
+ */
+static uint32_t analogCycles_ns(uint32_t HalfCycles)
+{
+    return HalfCycles * 500000 / (ADC_CLOCK_HZ / 1000);
+}
+
+/**
+ * @brief Determines if any of the users requires measurements.
+ * @return true if a user has channels requested
+ */
+static bool analogRequested(void)
+{
+    uint8_t user;
+
+    for (user = 0; user < ANALOG_USER_COUNT; user++)
+    {
+        if (analogUsers[user] != 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Returns the channels requested by any of the users.
+ * @return The channel mask
+ */
+static uint32_t analogRequestedChannels(void)
+{
+    uint32_t channels = ADCH_MASK(ADCH_VREFINT);
+    uint8_t user;
+
+    for (user = 0; user < ANALOG_USER_COUNT; user++)
+    {
+        channels |= analogUsers[user];
+    }
+    return channels;
+}
 
 #if (HW_REV > 0xA)
-    /*  I = Vmeas / (R=1K * k=1/1000) */
-    measurements.Iout_mA  = ADC_lCalcExt_mV(conversions[ADCH_IOUT]);
+/**
+ * @brief Arms the analog watchdog on the output current channel
+ *        if it is scanned and a limit is set. The ADC must be stopped.
+ */
+static void analogWatchdogConfig(void)
+{
+    ADC_IT_DISABLE(adc, AWD);
+
+    if (((adcScanMask & ADCH_MASK(ADCH_IOUT)) != 0) && (ioutLimit_mA > 0))
+    {
+        AnalogMeasurementsType *last = &measurements[measurementSeq & 1];
+        uint32_t vdda_mV = (last->Vdd_mV > 0) ? last->Vdd_mV : ANALOG_CAL_VDDA_mV;
+
+        /* I = Vmeas / (R=1K * k=1/1000), compared to the raw conversion */
+        uint32_t threshold = ioutLimit_mA * 4095 / vdda_mV;
+        if (threshold > 4095)
+        {
+            threshold = 4095;
+        }
+
+        ADC_REG_BIT(adc, CFGR1, AWDCH)  = IOUT_CH;
+        ADC_REG_BIT(adc, CFGR1, AWDSGL) = 1;
+        ADC_REG_BIT(adc, CFGR1, AWDEN)  = 1;
+        ADC_REG_BIT(adc, TR, LT) = 0;
+        ADC_REG_BIT(adc, TR, HT) = threshold;
+
+        ADC_FLAG_CLEAR(adc, AWD);
+        ADC_IT_ENABLE(adc, AWD);
+    }
+    else
+    {
+        ADC_REG_BIT(adc, CFGR1, AWDEN) = 0;
+    }
+}
+
+/**
+ * @brief Trips the output current limit when the watchdog detects
+ *        a conversion above the threshold. The watchdog remains
+ *        disarmed until the next scan configuration.
+ * @param handle: unused
+ */
+static void analogWatchdog(void * handle)
+{
+    ADC_IT_DISABLE(adc, AWD);
+    ADC_FLAG_CLEAR(adc, AWD);
+
+    if (ioutTrip != NULL)
+    {
+        ioutTrip();
+    }
+}
+#endif
+
+/**
+ * @brief Configures the requested channels and starts their conversions
+ *        with a new accumulation. The conversions are only triggered
+ *        while any user requires them. The conversion DMA must be stopped.
+ */
+static void analogStartConversions(void)
+{
+    uint8_t ch, i;
+
+    adcScanMask = analogRequestedChannels();
+    adcScanCount = 0;
+
+    for (ch = 0; ch < ADCH_COUNT; ch++)
+    {
+        if ((adcScanMask & ADCH_MASK(ch)) == 0)
+        {
+            continue;
+        }
+
+        /* On STM32F0 the scan order is according to the channel number */
+        for (i = adcScanCount;
+            (i > 0) && (adcChannels[adcScan[i - 1]].Number > adcChannels[ch].Number); i--)
+        {
+            adcScan[i] = adcScan[i - 1];
+        }
+        adcScan[i] = ch;
+        adcScanCount++;
+    }
+    for (i = 0; i < adcScanCount; i++)
+    {
+        adcScanConfig[i] = adcChannels[adcScan[i]];
+    }
+
+    ADC_vChannelConfig(adc, adcScanConfig, adcScanCount);
+#if (HW_REV > 0xA)
+    analogWatchdogConfig();
 #endif
+
+    /* Channels out of the scan are measured as 0 */
+    analogResetAccumulators();
+    ADC_eStart_DMA(adc, conversions);
+
+    adcTriggered = analogRequested();
+    if (adcTriggered)
+    {
+        TIM_vCounterStart(adc->Trigger);
+    }
+    else
+    {
+        TIM_vCounterStop(adc->Trigger);
+    }
+}
+
+/**
+ * @brief Applies the changed scan settings.
+ * @param arg: unused
+ */
+static void analogRescan(void * arg)
+{
+    ADC_vStop_DMA(adc);
+
+    if (analogRateChanged)
+    {
+        uint8_t ch;
+
+        /* Cleared first, a request meanwhile is applied by the next rescan */
+        analogRateChanged = false;
+        analogRate_Hz = analogReqRate_Hz;
+        for (ch = 0; ch < ADCH_COUNT; ch++)
+        {
+            adcChannels[ch].SampleTime = analogReqSampleTime;
+        }
+        adc->Trigger->Inst->ARR.w = analogTriggerPeriod(analogRate_Hz) - 1;
+        adc->Trigger->Inst->CNT.w = 0;
+        analogFrame_us = analogFramePeriod_us(analogRate_Hz);
+    }
+
+    analogStartConversions();
 }
 
 /**
@@ -131,10 +728,12 @@ void Analog_Init(void)
 {
     ADC_vInit(adc, &adcSettings);
     ADC_eCalibrate(adc, false);
+    analogCalibrate();
 
-    ADC_vChannelConfig(adc, adcChannels, sizeof(adcChannels)/sizeof(adcChannels[0]));
-
-    adc->Callbacks.ConvComplete = analogConvertMeasured;
+    adc->Callbacks.ConvComplete = analogAccumulate;
+#if (HW_REV > 0xA)
+    adc->Callbacks.Watchdog = analogWatchdog;
+#endif
 
     /* trigger timer settings */
     {
@@ -145,9 +744,10 @@ void Analog_Init(void)
         TIM_InitType stp = {
             .Mode               = TIM_COUNTER_UP,
         };
-        /* clock at 1 kHz, update with 100 Hz */
-        stp.Prescaler           = TIM_ulClockFreq_Hz(adc->Trigger) / 1000;
-        stp.Period              = 10;
+        /* clock at 1 MHz, update with the oversampled measurement rate */
+        stp.Prescaler           = TIM_ulClockFreq_Hz(adc->Trigger) / ANALOG_TRIGGER_CLOCK_HZ;
+        stp.Period              = analogTriggerPeriod(analogRate_Hz);
+        analogFrame_us          = analogFramePeriod_us(analogRate_Hz);
 
         TIM_vCounterInit(adc->Trigger, &stp);
 
@@ -155,7 +755,7 @@ void Analog_Init(void)
     }
 
     /* Actual conversions only start by the trigger */
-    ADC_eStart_DMA(adc, conversions);
+    analogStartConversions();
 }
 
 /**
@@ -163,6 +763,7 @@ void Analog_Init(void)
  */
 void Analog_Deinit(void)
 {
+    adcTriggered = false;
     TIM_vDeinit(adc->Trigger);
     ADC_vDeinit(adc);
 }
@@ -174,39 +775,235 @@ void Analog_Deinit(void)
  */
 void Analog_IoutConfig(int Enabled)
 {
-    uint8_t iout_disabled;
-    ADC_vStop_DMA(adc);
-
     if (Enabled)
     {
         GPIO_vInitPin(IOUT_PIN, IOUT_CFG);
-        iout_disabled = 0;
     }
-    else
+    Analog_SetChannels(ANALOG_USER_OUTPUT, Enabled ? ADCH_MASK(ADCH_IOUT) : 0);
+
+    /* A disarmed watchdog is armed again by the rescan */
+    if (Enabled && (ioutLimit_mA > 0) && (ADC_REG_BIT(adc, IER, AWDIE) == 0))
+    {
+        Sched_WorkSubmit(&analogRescanWork);
+    }
+}
+
+/**
+ * @brief Disarms the output current watchdog and stops the output metering
+ *        immediately, before the output current pin is driven.
+ *        Can be called from interrupts, the scan is only reconfigured
+ *        by @ref Analog_IoutConfig.
+ */
+void Analog_IoutDisarm(void)
+{
+    ADC_IT_DISABLE(adc, AWD);
+    ADC_FLAG_CLEAR(adc, AWD);
+    analogVout_mV = 0;
+}
+#endif
+
+/**
+ * @brief Sets the channels that a user requires to be measured.
+ *        The scan is reconfigured in the scheduler context to contain
+ *        only the channels requested by any user, the others are
+ *        measured as 0. The measurements stop when no user
+ *        requires any channels.
+ * @param User: the user of the channels
+ * @param Channels: the mask of the required channels (ADCH_MASK)
+ */
+void Analog_SetChannels(AnalogUserType User, uint32_t Channels)
+{
+    analogUsers[User] = Channels;
+
+#if (HW_REV > 0xA)
+    /* The released output current pin is no longer analog */
+    if ((analogRequestedChannels() & ADCH_MASK(ADCH_IOUT)) == 0)
+    {
+        ADC_IT_DISABLE(adc, AWD);
+    }
+#endif
+
+    if ((analogRequestedChannels() != adcScanMask) || (analogRequested() != adcTriggered))
+    {
+        Sched_WorkSubmit(&analogRescanWork);
+    }
+}
+
+#if (HW_REV > 0xA)
+/**
+ * @brief Sets the output current limit, which is monitored by the
+ *        analog watchdog on each conversion of the output current.
+ * @param Limit_mA: the current limit, 0 to disable the monitoring
+ * @param Trip: the function to call from the ADC interrupt
+ *              when the limit is exceeded
+ */
+void Analog_SetIoutLimit(uint32_t Limit_mA, void (*Trip)(void))
+{
+    ioutTrip = Trip;
+
+    /* The thresholds can only be written while the ADC is stopped */
+    if (Limit_mA != ioutLimit_mA)
     {
-        iout_disabled = 1;
-        conversions[ADCH_IOUT] = 0;
+        ioutLimit_mA = Limit_mA;
+        Sched_WorkSubmit(&analogRescanWork);
     }
+}
 
-    ADC_vChannelConfig(adc, &adcChannels[iout_disabled],
-            sizeof(adcChannels)/sizeof(adcChannels[0]) - iout_disabled);
+/**
+ * @brief Restarts the capture of the output current waveform. The ring is
+ *        filled with each conversion sequence, and frozen after a trigger
+ *        with @ref ANALOG_CAPTURE_PRETRIGGER samples of history.
+ * @param Threshold_mA: the output current to trigger the capture,
+ *                      0 to only trigger by @ref Analog_CaptureTrigger
+ */
+void Analog_CaptureArm(uint32_t Threshold_mA)
+{
+    AnalogMeasurementsType *last = &measurements[measurementSeq & 1];
+    uint32_t vdda_mV = (last->Vdd_mV > 0) ? last->Vdd_mV : ANALOG_CAL_VDDA_mV;
+    uint32_t threshold = Threshold_mA * 4095 / vdda_mV;
 
-    ADC_eStart_DMA(adc, &conversions[iout_disabled]);
+    captureArmThreshold = (threshold > 4095) ? 4095 : threshold;
+    captureArmRequest = true;
+}
+
+/**
+ * @brief Triggers the armed capture with the next conversion sequence.
+ */
+void Analog_CaptureTrigger(void)
+{
+    captureTriggerRequest = true;
+}
+
+/**
+ * @brief Returns the progress of the capture.
+ * @param Count: the number of captured samples
+ * @param Trigger: the index of the trigger sample, valid when done
+ * @return The state of the capture
+ */
+AnalogCaptureStateType Analog_CaptureStatus(uint16_t * Count, uint16_t * Trigger)
+{
+    AnalogCaptureStateType state = captureState;
+
+    *Count = captureCount;
+    *Trigger = (state == ANALOG_CAPTURE_DONE) ?
+            (uint16_t)(captureTriggerSeq - (captureTotal - captureCount)) : 0;
+    return state;
+}
+
+/**
+ * @brief Converts the samples of the frozen capture, the oldest is at index 0.
+ * @param Offset: the index of the first sample to read
+ * @param Samples: the converted samples
+ * @param Count: the number of samples to read
+ * @return The number of samples read, 0 if the capture is not done
+ */
+uint16_t Analog_CaptureRead(uint16_t Offset, AnalogCaptureSampleType * Samples, uint16_t Count)
+{
+    uint16_t i, start;
+
+    if ((captureState != ANALOG_CAPTURE_DONE) || (Offset >= captureCount))
+    {
+        return 0;
+    }
+    if (Count > (captureCount - Offset))
+    {
+        Count = captureCount - Offset;
+    }
+    start = (capturePos + ANALOG_CAPTURE_LENGTH - captureCount + Offset) % ANALOG_CAPTURE_LENGTH;
+
+    for (i = 0; i < Count; i++)
+    {
+        AnalogCaptureRawType *raw = &captureRing[(start + i) % ANALOG_CAPTURE_LENGTH];
+        uint32_t vdda_mV = 0, gain;
+
+        if (raw->Vref != 0)
+        {
+            vdda_mV = analogVddaCal / (raw->Vref << ANALOG_EXTRA_BITS);
+        }
+        gain = (vdda_mV * analogCoeffs[ADCH_IOUT]) >> (ANALOG_COEFF_BITS - 16);
+
+        Samples[i].Vdd_mV  = vdda_mV;
+        Samples[i].Iout_mA = ((raw->Iout << ANALOG_EXTRA_BITS) * gain) >> 16;
+    }
+    return Count;
+}
+
+/**
+ * @brief Sets the voltage of the output for the energy metering.
+ * @param Vout_mV: the output voltage, @ref ANALOG_VOUT_VDDA if it's
+ *                 the analog supply, 0 if the output is off
+ */
+void Analog_SetOutputVoltage(uint32_t Vout_mV)
+{
+    analogVout_mV = Vout_mV;
+}
+
+/**
+ * @brief Sets the function to receive each conversion of the output current,
+ *        at the rate returned by @ref Analog_GetScanRate_Hz.
+ * @param Monitor: the function to call from the ADC interrupt, or NULL
+ */
+void Analog_SetIoutMonitor(void (*Monitor)(uint32_t Iout_mA))
+{
+    ioutMonitor = Monitor;
 }
 #endif
 
 /**
- * @brief Halts measurements.
+ * @brief Changes the measurement rate and the sample time of the channels.
+ *        The sample time is shared by all channels on this ADC, so it has
+ *        to fit the internal channels, and the oversampled sequence
+ *        of all channels has to fit in the trigger period.
+ *        The new settings are applied in the scheduler context.
+ * @param Rate_Hz: the new measurement rate
+ * @param SampleTime: the new sample time (ADC_SAMPLETIME_*)
+ * @return true if the configuration is valid and applied
+ */
+bool Analog_SetSampling(uint16_t Rate_Hz, uint8_t SampleTime)
+{
+    uint32_t sequence_ns;
+
+    if ((Rate_Hz < ANALOG_MIN_RATE_HZ) || (Rate_Hz > ANALOG_MAX_RATE_HZ) ||
+        (SampleTime > ADC_SAMPLETIME_239p5) ||
+        (analogCycles_ns(adcSampleHalfCycles[SampleTime]) < ANALOG_MIN_SAMPLE_ns))
+    {
+        return false;
+    }
+
+    /* Leave a quarter of the period for the ADC wakeup and the DMA interrupt */
+    sequence_ns = ADCH_COUNT * analogCycles_ns(adcSampleHalfCycles[SampleTime]
+            + ANALOG_CONV_HALFCYCLES);
+    if ((sequence_ns * 5 / 4) >
+        (analogTriggerPeriod(Rate_Hz) * (1000000000 / ANALOG_TRIGGER_CLOCK_HZ)))
+    {
+        return false;
+    }
+
+    analogReqRate_Hz = Rate_Hz;
+    analogReqSampleTime = SampleTime;
+    analogRateChanged = true;
+
+    Sched_WorkSubmit(&analogRescanWork);
+    return true;
+}
+
+/**
+ * @brief Provides the configured measurement rate and sample time,
+ *        including the ones that are not yet applied.
+ * @param Rate_Hz: the measurement rate
+ * @param SampleTime: the sample time of the channels (ADC_SAMPLETIME_*)
  */
-void Analog_Halt(void)
+void Analog_GetSampling(uint16_t * Rate_Hz, uint8_t * SampleTime)
 {
-    TIM_vCounterStop(adc->Trigger);
+    *Rate_Hz = analogReqRate_Hz;
+    *SampleTime = analogReqSampleTime;
 }
 
 /**
- * @brief Resumes measurements.
+ * @brief Returns the rate of the conversion sequences.
+ * @return The oversampled measurement rate in Hz
  */
-void Analog_Resume(void)
+uint32_t Analog_GetScanRate_Hz(void)
 {
-    TIM_vCounterStart(adc->Trigger);
+    return (uint32_t)analogRate_Hz * ANALOG_OVERSAMPLING;
 }
@@ -24,6 +24,62 @@
 #define ANALOG_H_
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <scheduler.h>
+
+/* Analog channels, VREFINT is always converted as the VDDA reference */
+typedef enum
+{
+#if (HW_REV > 0xA)
+    ADCH_IOUT = 0,
+    ADCH_LIGHT_SENSOR,
+#else
+    ADCH_LIGHT_SENSOR = 0,
+#endif
+    ADCH_VBAT,
+    ADCH_ICHARGE,
+    ADCH_TEMP,
+    ADCH_VREFINT,
+    ADCH_COUNT
+}ADCHType;
+
+#define ADCH_MASK(CH)       (1 << (CH))
+
+/* Users of the analog channels */
+typedef enum
+{
+    ANALOG_USER_SENSOR = 0,
+    ANALOG_USER_CHARGER,
+#if (HW_REV > 0xA)
+    ANALOG_USER_OUTPUT,
+#endif
+    ANALOG_USER_COUNT
+}AnalogUserType;
+
+#if (HW_REV > 0xA)
+/* Length of the output current capture ring, in conversion sequences */
+#ifndef ANALOG_CAPTURE_LENGTH
+#define ANALOG_CAPTURE_LENGTH       128
+#endif
+/* Samples kept before the capture trigger */
+#ifndef ANALOG_CAPTURE_PRETRIGGER
+#define ANALOG_CAPTURE_PRETRIGGER   32
+#endif
+
+typedef enum
+{
+    ANALOG_CAPTURE_IDLE = 0,
+    ANALOG_CAPTURE_ARMED,
+    ANALOG_CAPTURE_TRIGGERED,
+    ANALOG_CAPTURE_DONE,
+}AnalogCaptureStateType;
+
+typedef struct
+{
+    uint16_t Iout_mA;
+    uint16_t Vdd_mV;
+}AnalogCaptureSampleType;
+#endif
 
 typedef struct
 {
@@ -35,13 +91,43 @@ typedef struct
     int32_t light_lx;
 }AnalogMeasurementsType;
 
+/* Integrated measurements, with overflow-safe counters */
+typedef struct
+{
+    uint64_t Time_us;           /* Integration time */
+#if (HW_REV > 0xA)
+    uint64_t Qout_nC;           /* Charge delivered on the output */
+    uint64_t Eout_pJ;           /* Energy delivered on the output */
+#endif
+    uint64_t Qchrg_nC;          /* Charge into the battery */
+    uint64_t Echrg_pJ;          /* Energy into the battery */
+}AnalogTotalsType;
+
+#if (HW_REV > 0xA)
+/* Output voltage of the energy metering when it is the analog supply */
+#define ANALOG_VOUT_VDDA            0xFFFFFFFF
+#endif
+
 void Analog_Init(void);
 void Analog_Deinit(void);
 #if (HW_REV > 0xA)
 void Analog_IoutConfig(int Enabled);
+void Analog_IoutDisarm(void);
+void Analog_SetIoutLimit(uint32_t Limit_mA, void (*Trip)(void));
+void Analog_SetIoutMonitor(void (*Monitor)(uint32_t Iout_mA));
+void Analog_SetOutputVoltage(uint32_t Vout_mV);
+void Analog_CaptureArm(uint32_t Threshold_mA);
+void Analog_CaptureTrigger(void);
+AnalogCaptureStateType Analog_CaptureStatus(uint16_t * Count, uint16_t * Trigger);
+uint16_t Analog_CaptureRead(uint16_t Offset, AnalogCaptureSampleType * Samples, uint16_t Count);
 #endif
-void Analog_Halt(void);
-void Analog_Resume(void);
-const AnalogMeasurementsType * Analog_GetValues(void);
+void Analog_SetChannels(AnalogUserType User, uint32_t Channels);
+bool Analog_SetSampling(uint16_t Rate_Hz, uint8_t SampleTime);
+void Analog_GetSampling(uint16_t * Rate_Hz, uint8_t * SampleTime);
+uint32_t Analog_GetScanRate_Hz(void);
+void Analog_GetValues(AnalogMeasurementsType * Values);
+void Analog_GetTotals(AnalogTotalsType * Totals);
+void Analog_ResetTotals(void);
+void Analog_SetNotification(Sched_WorkType * Work);
 
 #endif /* ANALOG_H_ */
@@ -36,17 +36,111 @@
   */
 #include <sens_if.h>
 #include <analog.h>
+#include <scheduler.h>
 #include <hid/usage_sensor.h>
 #include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
 
 #define REPORT_INTERVAL         100
 
+/* Shortest report interval, matches the measurement rate */
+#define SENSOR_MIN_INTERVAL     10
+
+/* Longest time without a report when the changes are below the sensitivity */
+#ifndef SENSOR_MAX_SILENCE
+#define SENSOR_MAX_SILENCE      1000
+#endif
+
+/* Scaler of the relative change sensitivities (0.01 %) */
+#define SENS_PCT_SCALER         10000
+
 #define TEMP_SCALER             100
 
 #define SENR_TEMP
 #define SENR_LIGHT
 #define SENR_VOLT
 
+/* Optional sensor properties, applied to all sensors */
+#define SENR_REPSTATE
+#define SENR_STATE
+#define SENR_EVENT
+
+#ifdef SENR_REPSTATE
+#define SENSOR_REPSTATE_DESC                                             \
+    /* Reporting state property */                                       \
+    HID_USAGE_SENSOR_PROPERTY_REPORTING_STATE,                           \
+    HID_LOGICAL_MIN_8(0),                                                \
+    HID_LOGICAL_MAX_8(5),                                                \
+    HID_REPORT_SIZE(8),                                                  \
+    HID_REPORT_COUNT(1),                                                 \
+    HID_COLLECTION_LOGICAL,                                              \
+        HID_USAGE_SENSOR_PROPERTY_REPORTING_STATE_NO_EVENTS,             \
+        HID_USAGE_SENSOR_PROPERTY_REPORTING_STATE_ALL_EVENTS,            \
+        HID_USAGE_SENSOR_PROPERTY_REPORTING_STATE_THRESHOLD_EVENTS,      \
+        HID_USAGE_SENSOR_PROPERTY_REPORTING_STATE_NO_EVENTS_WAKE,        \
+        HID_USAGE_SENSOR_PROPERTY_REPORTING_STATE_ALL_EVENTS_WAKE,       \
+        HID_USAGE_SENSOR_PROPERTY_REPORTING_STATE_THRESHOLD_EVENTS_WAKE, \
+        HID_FEATURE(Data_Arr_Abs),                                       \
+    HID_END_COLLECTION,
+#else
+#define SENSOR_REPSTATE_DESC
+#endif /* SENR_REPSTATE */
+
+#ifdef SENR_STATE
+#define SENSOR_STATE_DESC                                   \
+    /* Sensor state (global) */                             \
+    HID_USAGE_SENSOR_STATE,                                 \
+    HID_LOGICAL_MIN_8(0),                                   \
+    HID_LOGICAL_MAX_8(6),                                   \
+    HID_REPORT_SIZE(8),                                     \
+    HID_REPORT_COUNT(1),                                    \
+    HID_COLLECTION_LOGICAL,                                 \
+        HID_USAGE_SENSOR_STATE_UNKNOWN,                     \
+        HID_USAGE_SENSOR_STATE_READY,                       \
+        HID_USAGE_SENSOR_STATE_NOT_AVAILABLE,               \
+        HID_USAGE_SENSOR_STATE_NO_DATA,                     \
+        HID_USAGE_SENSOR_STATE_INITIALIZING,                \
+        HID_USAGE_SENSOR_STATE_ACCESS_DENIED,               \
+        HID_USAGE_SENSOR_STATE_ERROR,                       \
+        HID_INPUT(Data_Arr_Abs),                            \
+    HID_END_COLLECTION,
+#else
+#define SENSOR_STATE_DESC
+#endif /* SENR_STATE */
+
+#ifdef SENR_EVENT
+#define SENSOR_EVENT_DESC                                     \
+    /* Sensor event settings */                               \
+    HID_USAGE_SENSOR_EVENT,                                   \
+    HID_LOGICAL_MIN_8(0),                                     \
+    HID_LOGICAL_MAX_8(16),                                    \
+    HID_REPORT_SIZE(8),                                       \
+    HID_REPORT_COUNT(1),                                      \
+    HID_COLLECTION_LOGICAL,                                   \
+        HID_USAGE_SENSOR_EVENT_UNKNOWN,                       \
+        HID_USAGE_SENSOR_EVENT_STATE_CHANGED,                 \
+        HID_USAGE_SENSOR_EVENT_PROPERTY_CHANGED,              \
+        HID_USAGE_SENSOR_EVENT_DATA_UPDATED,                  \
+        HID_USAGE_SENSOR_EVENT_POLL_RESPONSE,                 \
+        HID_USAGE_SENSOR_EVENT_CHANGE_SENSITIVITY,            \
+        HID_USAGE_SENSOR_EVENT_MAX_REACHED,                   \
+        HID_USAGE_SENSOR_EVENT_MIN_REACHED,                   \
+        HID_USAGE_SENSOR_EVENT_HIGH_THRESHOLD_CROSS_UPWARD,   \
+        HID_USAGE_SENSOR_EVENT_HIGH_THRESHOLD_CROSS_DOWNWARD, \
+        HID_USAGE_SENSOR_EVENT_LOW_THRESHOLD_CROSS_UPWARD,    \
+        HID_USAGE_SENSOR_EVENT_LOW_THRESHOLD_CROSS_DOWNWARD,  \
+        HID_USAGE_SENSOR_EVENT_ZERO_THRESHOLD_CROSS_UPWARD,   \
+        HID_USAGE_SENSOR_EVENT_ZERO_THRESHOLD_CROSS_DOWNWARD, \
+        HID_USAGE_SENSOR_EVENT_PERIOD_EXCEEDED,               \
+        HID_USAGE_SENSOR_EVENT_FREQUENCY_EXCEEDED,            \
+        HID_USAGE_SENSOR_EVENT_COMPLEX_TRIGGER,               \
+        HID_INPUT(Data_Arr_Abs),                              \
+    HID_END_COLLECTION,
+#else
+#define SENSOR_EVENT_DESC
+#endif /* SENR_EVENT */
+
 /** @brief HID report descriptor of sens_if */
 __alignment(USBD_DATA_ALIGNMENT)
 static const uint8_t SensorReport[] __align(USBD_DATA_ALIGNMENT) =
@@ -62,23 +156,7 @@ static const uint8_t SensorReport[] __align(USBD_DATA_ALIGNMENT) =
         HID_USAGE_SENSOR_TYPE_ENVIRONMENTAL_TEMPERATURE,
         HID_COLLECTION_PHYSICAL(
 
-#ifdef SENR_TEMP_REPSTATE
-            /* Reporting state property */
-            HID_USAGE_SENSOR_PROPERTY_REPORTING_STATE,
-            HID_LOGICAL_MIN_8(0),
-            HID_LOGICAL_MAX_8(5),
-            HID_REPORT_SIZE(8),
-            HID_REPORT_COUNT(1),
-            HID_COLLECTION_LOGICAL,
-                HID_USAGE_SENSOR_PROPERTY_REPORTING_STATE_NO_EVENTS,
-                HID_USAGE_SENSOR_PROPERTY_REPORTING_STATE_ALL_EVENTS,
-                HID_USAGE_SENSOR_PROPERTY_REPORTING_STATE_THRESHOLD_EVENTS,
-                HID_USAGE_SENSOR_PROPERTY_REPORTING_STATE_NO_EVENTS_WAKE,
-                HID_USAGE_SENSOR_PROPERTY_REPORTING_STATE_ALL_EVENTS_WAKE,
-                HID_USAGE_SENSOR_PROPERTY_REPORTING_STATE_THRESHOLD_EVENTS_WAKE,
-                HID_FEATURE(Data_Arr_Abs),
-            HID_END_COLLECTION,
-#endif /* SENR_TEMP_REPSTATE */
+            SENSOR_REPSTATE_DESC
 
             /* Report interval property */
             HID_USAGE_SENSOR_PROPERTY_REPORT_INTERVAL,
@@ -89,6 +167,28 @@ static const uint8_t SensorReport[] __align(USBD_DATA_ALIGNMENT) =
             HID_UNIT_EXPONENT(0),
             HID_FEATURE(Data_Var_Abs),
 
+            /* Change sensitivity of temperature (absolute) */
+            HID_USAGE_SENSOR_DATA(
+                    HID_USAGE_SENSOR_DATA_ENVIRONMENTAL_TEMPERATURE,
+                    HID_USAGE_SENSOR_DATA_MOD_CHANGE_SENSITIVITY_ABS),
+            HID_LOGICAL_MIN_8(0),
+            HID_LOGICAL_MAX_16(32767),
+            HID_REPORT_SIZE(16),
+            HID_REPORT_COUNT(1),
+            HID_UNIT_EXPONENT(-2),
+            HID_FEATURE(Data_Var_Abs),
+
+            /* Change sensitivity of temperature (percent of the last reported value) */
+            HID_USAGE_SENSOR_DATA(
+                    HID_USAGE_SENSOR_DATA_ENVIRONMENTAL_TEMPERATURE,
+                    HID_USAGE_SENSOR_DATA_MOD_CHANGE_SENSITIVITY_REL_PCT),
+            HID_LOGICAL_MIN_8(0),
+            HID_LOGICAL_MAX_16(10000),
+            HID_REPORT_SIZE(16),
+            HID_REPORT_COUNT(1),
+            HID_UNIT_EXPONENT(-2),
+            HID_FEATURE(Data_Var_Abs),
+
             /* Modifier property of temperature (maximum value) */
             HID_USAGE_SENSOR_DATA(
                     HID_USAGE_SENSOR_DATA_ENVIRONMENTAL_TEMPERATURE,
@@ -111,53 +211,8 @@ static const uint8_t SensorReport[] __align(USBD_DATA_ALIGNMENT) =
             HID_UNIT_EXPONENT(-2),
             HID_FEATURE(Data_Var_Abs),
 
-#ifdef SENR_TEMP_STATE
-            /* Sensor state (global) */
-            HID_USAGE_SENSOR_STATE,
-            HID_LOGICAL_MIN_8(0),
-            HID_LOGICAL_MAX_8(6),
-            HID_REPORT_SIZE(8),
-            HID_REPORT_COUNT(1),
-            HID_COLLECTION_LOGICAL,
-                HID_USAGE_SENSOR_STATE_UNKNOWN,
-                HID_USAGE_SENSOR_STATE_READY,
-                HID_USAGE_SENSOR_STATE_NOT_AVAILABLE,
-                HID_USAGE_SENSOR_STATE_NO_DATA,
-                HID_USAGE_SENSOR_STATE_INITIALIZING,
-                HID_USAGE_SENSOR_STATE_ACCESS_DENIED,
-                HID_USAGE_SENSOR_STATE_ERROR,
-                HID_INPUT(Data_Arr_Abs),
-            HID_END_COLLECTION,
-#endif /* SENR_TEMP_STATE */
-
-#ifdef SENR_TEMP_EVENT
-            /* Sensor event settings */
-            HID_USAGE_SENSOR_EVENT,
-            HID_LOGICAL_MIN_8(0),
-            HID_LOGICAL_MAX_8(16),
-            HID_REPORT_SIZE(8),
-            HID_REPORT_COUNT(1),
-            HID_COLLECTION_LOGICAL,
-                HID_USAGE_SENSOR_EVENT_UNKNOWN,
-                HID_USAGE_SENSOR_EVENT_STATE_CHANGED,
-                HID_USAGE_SENSOR_EVENT_PROPERTY_CHANGED,
-                HID_USAGE_SENSOR_EVENT_DATA_UPDATED,
-                HID_USAGE_SENSOR_EVENT_POLL_RESPONSE,
-                HID_USAGE_SENSOR_EVENT_CHANGE_SENSITIVITY,
-                HID_USAGE_SENSOR_EVENT_MAX_REACHED,
-                HID_USAGE_SENSOR_EVENT_MIN_REACHED,
-                HID_USAGE_SENSOR_EVENT_HIGH_THRESHOLD_CROSS_UPWARD,
-                HID_USAGE_SENSOR_EVENT_HIGH_THRESHOLD_CROSS_DOWNWARD,
-                HID_USAGE_SENSOR_EVENT_LOW_THRESHOLD_CROSS_UPWARD,
-                HID_USAGE_SENSOR_EVENT_LOW_THRESHOLD_CROSS_DOWNWARD,
-                HID_USAGE_SENSOR_EVENT_ZERO_THRESHOLD_CROSS_UPWARD,
-                HID_USAGE_SENSOR_EVENT_ZERO_THRESHOLD_CROSS_DOWNWARD,
-                HID_USAGE_SENSOR_EVENT_PERIOD_EXCEEDED,
-                HID_USAGE_SENSOR_EVENT_FREQUENCY_EXCEEDED,
-                HID_USAGE_SENSOR_EVENT_COMPLEX_TRIGGER,
-                HID_INPUT(Data_Arr_Abs),
-            HID_END_COLLECTION,
-#endif /* SENR_TEMP_EVENT */
+            SENSOR_STATE_DESC
+            SENSOR_EVENT_DESC
 
             /* Temperature sensor input */
             HID_USAGE_SENSOR_DATA_ENVIRONMENTAL_TEMPERATURE,
@@ -178,6 +233,8 @@ static const uint8_t SensorReport[] __align(USBD_DATA_ALIGNMENT) =
         HID_USAGE_SENSOR_TYPE_LIGHT_AMBIENTLIGHT,
         HID_COLLECTION_PHYSICAL(
 
+            SENSOR_REPSTATE_DESC
+
             /* Report interval property */
             HID_USAGE_SENSOR_PROPERTY_REPORT_INTERVAL,
             HID_LOGICAL_MIN_8(0),
@@ -187,6 +244,28 @@ static const uint8_t SensorReport[] __align(USBD_DATA_ALIGNMENT) =
             HID_UNIT_EXPONENT(0),
             HID_FEATURE(Data_Var_Abs),
 
+            /* Change sensitivity of illuminance (absolute) */
+            HID_USAGE_SENSOR_DATA(
+                    HID_USAGE_SENSOR_DATA_LIGHT_ILLUMINANCE,
+                    HID_USAGE_SENSOR_DATA_MOD_CHANGE_SENSITIVITY_ABS),
+            HID_LOGICAL_MIN_8(0),
+            HID_LOGICAL_MAX_16(0xFFFF),
+            HID_REPORT_SIZE(16),
+            HID_REPORT_COUNT(1),
+            HID_UNIT_EXPONENT(0),
+            HID_FEATURE(Data_Var_Abs),
+
+            /* Change sensitivity of illuminance (percent of the last reported value) */
+            HID_USAGE_SENSOR_DATA(
+                    HID_USAGE_SENSOR_DATA_LIGHT_ILLUMINANCE,
+                    HID_USAGE_SENSOR_DATA_MOD_CHANGE_SENSITIVITY_REL_PCT),
+            HID_LOGICAL_MIN_8(0),
+            HID_LOGICAL_MAX_16(10000),
+            HID_REPORT_SIZE(16),
+            HID_REPORT_COUNT(1),
+            HID_UNIT_EXPONENT(-2),
+            HID_FEATURE(Data_Var_Abs),
+
             /* Modifier property of illuminance (maximum value) */
             HID_USAGE_SENSOR_DATA(
                     HID_USAGE_SENSOR_DATA_LIGHT_ILLUMINANCE,
@@ -209,6 +288,9 @@ static const uint8_t SensorReport[] __align(USBD_DATA_ALIGNMENT) =
             HID_UNIT_EXPONENT(0),
             HID_FEATURE(Data_Var_Abs),
 
+            SENSOR_STATE_DESC
+            SENSOR_EVENT_DESC
+
             /* Illuminance sensor input */
             HID_USAGE_SENSOR_DATA_LIGHT_ILLUMINANCE,
             HID_LOGICAL_MIN_16(0),
@@ -227,6 +309,8 @@ static const uint8_t SensorReport[] __align(USBD_DATA_ALIGNMENT) =
         HID_USAGE_SENSOR_TYPE_ELECTRICAL_VOLTAGE,
         HID_COLLECTION_PHYSICAL(
 
+            SENSOR_REPSTATE_DESC
+
             /* Report interval property */
             HID_USAGE_SENSOR_PROPERTY_REPORT_INTERVAL,
             HID_LOGICAL_MIN_8(0),
@@ -236,6 +320,28 @@ static const uint8_t SensorReport[] __align(USBD_DATA_ALIGNMENT) =
             HID_UNIT_EXPONENT(0),
             HID_FEATURE(Data_Var_Abs),
 
+            /* Change sensitivity of voltage (absolute) */
+            HID_USAGE_SENSOR_DATA(
+                    HID_USAGE_SENSOR_DATA_ELECTRICAL_VOLTAGE,
+                    HID_USAGE_SENSOR_DATA_MOD_CHANGE_SENSITIVITY_ABS),
+            HID_LOGICAL_MIN_8(0),
+            HID_LOGICAL_MAX_16(0xFFFF),
+            HID_REPORT_SIZE(16),
+            HID_REPORT_COUNT(1),
+            HID_UNIT_EXPONENT(-3),
+            HID_FEATURE(Data_Var_Abs),
+
+            /* Change sensitivity of voltage (percent of the last reported value) */
+            HID_USAGE_SENSOR_DATA(
+                    HID_USAGE_SENSOR_DATA_ELECTRICAL_VOLTAGE,
+                    HID_USAGE_SENSOR_DATA_MOD_CHANGE_SENSITIVITY_REL_PCT),
+            HID_LOGICAL_MIN_8(0),
+            HID_LOGICAL_MAX_16(10000),
+            HID_REPORT_SIZE(16),
+            HID_REPORT_COUNT(1),
+            HID_UNIT_EXPONENT(-2),
+            HID_FEATURE(Data_Var_Abs),
+
             /* Modifier property of voltage (maximum value) */
             HID_USAGE_SENSOR_DATA(
                     HID_USAGE_SENSOR_DATA_ELECTRICAL_VOLTAGE,
@@ -258,6 +364,9 @@ static const uint8_t SensorReport[] __align(USBD_DATA_ALIGNMENT) =
             HID_UNIT_EXPONENT(-3),
             HID_FEATURE(Data_Var_Abs),
 
+            SENSOR_STATE_DESC
+            SENSOR_EVENT_DESC
+
             /* Voltage sensor input */
             HID_USAGE_SENSOR_DATA_ELECTRICAL_VOLTAGE,
             HID_LOGICAL_MIN_16(0),
@@ -275,91 +384,494 @@ static const uint8_t SensorReport[] __align(USBD_DATA_ALIGNMENT) =
 #endif /* 1 */
 };
 
-/** @brief HID Input report */
-typedef struct {
+/* Sensor indexes, in the order of the report descriptor */
+enum
+{
 #ifdef SENR_TEMP
-#ifdef SENR_TEMP_REPSTATE
-    uint8_t repstate;
+    SENS_TEMP,
 #endif
-#ifdef SENR_TEMP_STATE
+#ifdef SENR_LIGHT
+    SENS_LIGHT,
+#endif
+#ifdef SENR_VOLT
+    SENS_VOLT,
+#endif
+    SENS_COUNT
+};
+
+/* Due flag of the keepalive report */
+#define SENS_KEEPALIVE          (1 << SENS_COUNT)
+
+/* Values of the reporting state property, in the order of the descriptor */
+enum
+{
+    SENS_REPSTATE_NO_EVENTS = 0,
+    SENS_REPSTATE_ALL_EVENTS,
+    SENS_REPSTATE_THRESHOLD_EVENTS,
+    SENS_REPSTATE_NO_EVENTS_WAKE,
+    SENS_REPSTATE_ALL_EVENTS_WAKE,
+    SENS_REPSTATE_THRESHOLD_EVENTS_WAKE,
+};
+
+/* Values of the sensor state, in the order of the descriptor */
+enum
+{
+    SENS_STATE_UNKNOWN = 0,
+    SENS_STATE_READY,
+    SENS_STATE_NOT_AVAILABLE,
+    SENS_STATE_NO_DATA,
+    SENS_STATE_INITIALIZING,
+    SENS_STATE_ACCESS_DENIED,
+    SENS_STATE_ERROR,
+};
+
+/* Values of the sensor event, in the order of the descriptor */
+enum
+{
+    SENS_EVENT_UNKNOWN = 0,
+    SENS_EVENT_STATE_CHANGED,
+    SENS_EVENT_PROPERTY_CHANGED,
+    SENS_EVENT_DATA_UPDATED,
+    SENS_EVENT_POLL_RESPONSE,
+    SENS_EVENT_CHANGE_SENSITIVITY,
+    SENS_EVENT_MAX_REACHED,
+    SENS_EVENT_MIN_REACHED,
+    SENS_EVENT_HIGH_THRESHOLD_CROSS_UPWARD,
+    SENS_EVENT_HIGH_THRESHOLD_CROSS_DOWNWARD,
+    SENS_EVENT_LOW_THRESHOLD_CROSS_UPWARD,
+    SENS_EVENT_LOW_THRESHOLD_CROSS_DOWNWARD,
+};
+
+/* Position of a value relative to the min/max thresholds */
+enum
+{
+    SENS_ZONE_NORMAL = 0,
+    SENS_ZONE_HIGH,
+    SENS_ZONE_LOW,
+};
+
+/** @brief HID Input report of a sensor */
+typedef struct {
+#ifdef SENR_STATE
     uint8_t state;
 #endif
-#ifdef SENR_TEMP_EVENT
+#ifdef SENR_EVENT
     uint8_t event;
 #endif
-    int16_t temp;
-#endif
-#ifdef SENR_LIGHT
-    uint16_t illum;
+    uint16_t value;         /* Signed for the temperature */
+}__packed Sensor_InDataType;
+
+/** @brief HID Input report */
+typedef struct {
+    Sensor_InDataType sensor[SENS_COUNT];
+}__packed Sensor_InReportType;
+
+/** @brief HID Feature report of a sensor */
+typedef struct {
+#ifdef SENR_REPSTATE
+    uint8_t repstate;
 #endif
-#ifdef SENR_VOLT
-    uint16_t volt;
+    uint32_t interval;
+    uint16_t sensAbs;
+    uint16_t sensPct;
+    uint16_t max;           /* Signed for the temperature */
+    uint16_t min;           /* Signed for the temperature */
+}__packed Sensor_FeatureDataType;
+
+#ifdef SENR_REPSTATE
+#define SENS_FEATURE_INIT(MAX, MIN)     \
+    { SENS_REPSTATE_ALL_EVENTS, REPORT_INTERVAL, 0, 0, (uint16_t)(MAX), (uint16_t)(MIN) }
+#else
+#define SENS_FEATURE_INIT(MAX, MIN)     \
+    { REPORT_INTERVAL, 0, 0, (uint16_t)(MAX), (uint16_t)(MIN) }
 #endif
-}__packed Sensor_InReportType;
 
 /** @brief HID Feature report */
 struct {
-#ifdef SENR_TEMP
-    struct {
-        uint32_t interval;
-        int16_t max;
-        int16_t min;
-    }temp;
-#endif
-#ifdef SENR_LIGHT
-    struct {
-        uint32_t interval;
-        uint16_t max;
-        uint16_t min;
-    }illum;
-#endif
-#ifdef SENR_VOLT
-    struct {
-        uint32_t interval;
-        uint16_t max;
-        uint16_t min;
-    }volt;
-#endif
+    Sensor_FeatureDataType sensor[SENS_COUNT];
 }__packed sens_feature __align(USBD_DATA_ALIGNMENT) = {
+    .sensor = {
 #ifdef SENR_TEMP
-    { REPORT_INTERVAL, 150 * TEMP_SCALER, -50 * TEMP_SCALER },
+        [SENS_TEMP]  = SENS_FEATURE_INIT(150 * TEMP_SCALER, -50 * TEMP_SCALER),
 #endif
 #ifdef SENR_LIGHT
-    { REPORT_INTERVAL, 10000, 0 },
+        [SENS_LIGHT] = SENS_FEATURE_INIT(10000, 0),
 #endif
 #ifdef SENR_VOLT
-    { REPORT_INTERVAL, 10 * 1000, 0 },
+        [SENS_VOLT]  = SENS_FEATURE_INIT(10 * 1000, 0),
 #endif
+    },
 };
 
 const USBD_HID_ReportConfigType sensReportConfig = {
         .Desc = SensorReport,
         .DescLength = sizeof(SensorReport),
         .Input.MaxSize = sizeof(Sensor_InReportType),
-        .Input.Interval_ms = REPORT_INTERVAL,
+        .Input.Interval_ms = SENSOR_MIN_INTERVAL,
         .Feature.MaxSize = sizeof(sens_feature),
 };
 
+static void Sensor_Update(void * arg);
+static void Sensor_Due(void * arg);
+static void Sensor_Retry(void * arg);
+
+static Sched_TimerType sensTimers[SENS_COUNT];
+static Sched_TimerType sensSilence = {
+    .Callback = Sensor_Due,
+    .Arg = (void*)(uintptr_t)SENS_COUNT,
+};
+static Sched_TimerType sensRetry = {
+    .Callback = Sensor_Retry,
+};
+static Sched_WorkType sensWork = {
+    .Callback = Sensor_Update,
+};
+static volatile uint8_t sensDue = 0;
+static bool sensKeepalive = false;
+
+/** @brief The last sent IN report */
+static Sensor_InReportType sens_last;
+
+/** @brief The threshold zones of the sensor values */
+static uint8_t sensZones[SENS_COUNT];
+
 /**
- * @brief Sends the IN report
+ * @brief Fills the IN report with the current measurements.
+ * @param input: the report to fill
+ * @param event: the event to set for all sensors
  */
-static void Sensor_SendInput(void)
+static void Sensor_Measure(Sensor_InReportType * input, uint8_t event)
 {
-    Sensor_InReportType sens_input;
-    const AnalogMeasurementsType * meas = Analog_GetValues();
+    AnalogMeasurementsType meas;
+    uint8_t sensor;
+
+    Analog_GetValues(&meas);
 
 #ifdef SENR_TEMP
-    sens_input.temp  = ( int16_t)meas->temp_C * TEMP_SCALER;
+    input->sensor[SENS_TEMP].value  = (uint16_t)(meas.temp_C * TEMP_SCALER);
 #endif
 #ifdef SENR_LIGHT
-    sens_input.illum = (uint16_t)meas->light_lx;
+    input->sensor[SENS_LIGHT].value = (uint16_t)meas.light_lx;
 #endif
 #ifdef SENR_VOLT
-    sens_input.volt  = (uint16_t)meas->Vdd_mV;
+    input->sensor[SENS_VOLT].value  = (uint16_t)meas.Vdd_mV;
 #endif
 
+    for (sensor = 0; sensor < SENS_COUNT; sensor++)
+    {
+#ifdef SENR_STATE
+        input->sensor[sensor].state = SENS_STATE_READY;
+#endif
+#ifdef SENR_EVENT
+        input->sensor[sensor].event = event;
+#endif
+    }
+}
+
+/**
+ * @brief Sends the IN report
+ */
+static void Sensor_SendInput(void)
+{
+    Sensor_InReportType sens_input;
+
+    Sensor_Measure(&sens_input, SENS_EVENT_POLL_RESPONSE);
+    sens_last = sens_input;
+
     USBD_HID_ReportIn(sens_if, (uint8_t*)&sens_input, sizeof(sens_input));
 }
+
+/**
+ * @brief Converts a report field of a sensor to its numeric value.
+ * @param sensor: the sensor index
+ * @param field: the report field
+ * @return The signed value of the field
+ */
+static int32_t Sensor_Value(uint8_t sensor, uint16_t field)
+{
+#ifdef SENR_TEMP
+    if (sensor == SENS_TEMP)
+    {
+        return (int16_t)field;
+    }
+#endif
+    return field;
+}
+
+/**
+ * @brief Returns the reporting state of a sensor, without the wake option.
+ * @param sensor: the sensor index
+ * @return SENS_REPSTATE_NO_EVENTS, SENS_REPSTATE_ALL_EVENTS
+ *         or SENS_REPSTATE_THRESHOLD_EVENTS
+ */
+static uint8_t Sensor_GetRepState(uint8_t sensor)
+{
+#ifdef SENR_REPSTATE
+    /* The wake variants only differ in the system power management */
+    switch (sens_feature.sensor[sensor].repstate)
+    {
+        case SENS_REPSTATE_NO_EVENTS:
+        case SENS_REPSTATE_NO_EVENTS_WAKE:
+            return SENS_REPSTATE_NO_EVENTS;
+        case SENS_REPSTATE_THRESHOLD_EVENTS:
+        case SENS_REPSTATE_THRESHOLD_EVENTS_WAKE:
+            return SENS_REPSTATE_THRESHOLD_EVENTS;
+        default:
+            return SENS_REPSTATE_ALL_EVENTS;
+    }
+#else
+    return SENS_REPSTATE_ALL_EVENTS;
+#endif
+}
+
+/**
+ * @brief Checks a value change against the change sensitivities.
+ *        Both sensitivities have to be met, a zero sensitivity
+ *        accepts any change.
+ * @param diff: the absolute change since the last report
+ * @param last: the absolute last reported value
+ * @param sensAbs: the absolute change sensitivity
+ * @param sensPct: the relative change sensitivity in 0.01 %
+ * @param minDiff: the smallest reportable change
+ * @return true if the change is reportable
+ */
+static bool Sensor_Exceeds(uint32_t diff, uint32_t last,
+        uint16_t sensAbs, uint16_t sensPct, uint32_t minDiff)
+{
+    return (diff >= minDiff) && (diff >= sensAbs)
+        && ((diff * SENS_PCT_SCALER) >= (last * sensPct));
+}
+
+/**
+ * @brief Determines if the measured value of a sensor moved
+ *        at least by its change sensitivity since the last report.
+ * @param sensor: the sensor index
+ * @param input: the current measurements
+ * @param minDiff: the smallest reportable change
+ * @return true if the change is reportable
+ */
+static bool Sensor_Changed(uint8_t sensor, const Sensor_InReportType * input, uint32_t minDiff)
+{
+    const Sensor_FeatureDataType * feature = &sens_feature.sensor[sensor];
+    int32_t value = Sensor_Value(sensor, input->sensor[sensor].value);
+    int32_t last  = Sensor_Value(sensor, sens_last.sensor[sensor].value);
+
+    return Sensor_Exceeds(abs(value - last), abs(last),
+            feature->sensAbs, feature->sensPct, minDiff);
+}
+
+/**
+ * @brief Tracks the position of the sensor value relative to
+ *        the min/max properties, which act as event thresholds.
+ * @param sensor: the sensor index
+ * @param input: the current measurements
+ * @param zone: the current zone of the value, only to be committed
+ *              when the crossing event is reported
+ * @return The threshold crossing event, or SENS_EVENT_UNKNOWN if none
+ */
+static uint8_t Sensor_Threshold(uint8_t sensor, const Sensor_InReportType * input, uint8_t * zone)
+{
+    const Sensor_FeatureDataType * feature = &sens_feature.sensor[sensor];
+    int32_t value = Sensor_Value(sensor, input->sensor[sensor].value);
+    uint8_t event = SENS_EVENT_UNKNOWN;
+
+    *zone = SENS_ZONE_NORMAL;
+    if (value > Sensor_Value(sensor, feature->max))
+    {
+        *zone = SENS_ZONE_HIGH;
+    }
+    else if (value < Sensor_Value(sensor, feature->min))
+    {
+        *zone = SENS_ZONE_LOW;
+    }
+
+    if (*zone != sensZones[sensor])
+    {
+        if (*zone == SENS_ZONE_HIGH)
+        {
+            event = SENS_EVENT_HIGH_THRESHOLD_CROSS_UPWARD;
+        }
+        else if (*zone == SENS_ZONE_LOW)
+        {
+            event = SENS_EVENT_LOW_THRESHOLD_CROSS_DOWNWARD;
+        }
+        else if (sensZones[sensor] == SENS_ZONE_HIGH)
+        {
+            event = SENS_EVENT_HIGH_THRESHOLD_CROSS_DOWNWARD;
+        }
+        else
+        {
+            event = SENS_EVENT_LOW_THRESHOLD_CROSS_UPWARD;
+        }
+    }
+
+    return event;
+}
+
+/**
+ * @brief Sends the IN report if any of the sensors has an event:
+ *        a threshold crossing, or if all events are reported,
+ *        an update by its interval or by the change of its value
+ *        that exceeds its sensitivity. The updates are sent regardless
+ *        after the maximum silence time. A report that is rejected
+ *        by the busy endpoint is retried with the same due flags.
+ * @param arg: unused
+ */
+static void Sensor_Update(void * arg)
+{
+    Sensor_InReportType sens_input;
+    uint8_t zones[SENS_COUNT];
+    uint8_t due = sensDue, sensor;
+    bool report = false;
+
+    sensDue = 0;
+    Sensor_Measure(&sens_input, SENS_EVENT_UNKNOWN);
+    memcpy(zones, sensZones, sizeof(zones));
+
+    for (sensor = 0; sensor < SENS_COUNT; sensor++)
+    {
+        uint8_t repstate = Sensor_GetRepState(sensor);
+        uint8_t event;
+
+        if (repstate == SENS_REPSTATE_NO_EVENTS)
+        {
+            continue;
+        }
+
+        event = Sensor_Threshold(sensor, &sens_input, &zones[sensor]);
+
+        if ((event == SENS_EVENT_UNKNOWN) && (repstate == SENS_REPSTATE_ALL_EVENTS))
+        {
+            if ((due & SENS_KEEPALIVE) != 0)
+            {
+                event = SENS_EVENT_DATA_UPDATED;
+            }
+            else if ((due & (1 << sensor)) != 0)
+            {
+                if (Sensor_Changed(sensor, &sens_input, 0))
+                {
+                    event = SENS_EVENT_DATA_UPDATED;
+                }
+            }
+            /* On-change sensors report actual changes only */
+            else if ((sens_feature.sensor[sensor].interval == 0) &&
+                     Sensor_Changed(sensor, &sens_input, 1))
+            {
+                event = SENS_EVENT_DATA_UPDATED;
+            }
+        }
+
+        if (event != SENS_EVENT_UNKNOWN)
+        {
+#ifdef SENR_EVENT
+            sens_input.sensor[sensor].event = event;
+#endif
+            report = true;
+        }
+    }
+
+    /* A single report serves all sensors that have an event at the same time */
+    if (report)
+    {
+        if (USBD_E_OK == USBD_HID_ReportIn(sens_if, (uint8_t*)&sens_input, sizeof(sens_input)))
+        {
+            sens_last = sens_input;
+            memcpy(sensZones, zones, sizeof(sensZones));
+
+            if (sensKeepalive)
+            {
+                Sched_TimerStart(&sensSilence, SENSOR_MAX_SILENCE, 0);
+            }
+        }
+        else
+        {
+            /* The changes and crossings are evaluated against
+             * the last sent values */
+            sensDue |= due;
+            Sched_TimerStart(&sensRetry, 1, 0);
+        }
+    }
+}
+
+/**
+ * @brief Reevaluates the sensors after a rejected report.
+ * @param arg: unused
+ */
+static void Sensor_Retry(void * arg)
+{
+    Sched_WorkSubmit(&sensWork);
+}
+
+/**
+ * @brief Marks the sensor as due for reporting.
+ * @param arg: the sensor index
+ */
+static void Sensor_Due(void * arg)
+{
+    sensDue |= 1 << (uintptr_t)arg;
+    Sched_WorkSubmit(&sensWork);
+}
+
+/**
+ * @brief Schedules the sensor reports according to the reporting states
+ *        and the report intervals. Intervals below the measurement rate
+ *        are raised to it, the sensors with 0 interval are reported when
+ *        their value changes. The threshold events are checked at the
+ *        evaluation of the sensor, which is each measurement for the
+ *        sensors that only report threshold events.
+ */
+static void Sensor_Schedule(void)
+{
+    bool onMeasure = false;
+    uint8_t sensor;
+
+    sensKeepalive = false;
+
+    for (sensor = 0; sensor < SENS_COUNT; sensor++)
+    {
+        uint8_t repstate = Sensor_GetRepState(sensor);
+        uint32_t interval = sens_feature.sensor[sensor].interval;
+
+        if (repstate != SENS_REPSTATE_ALL_EVENTS)
+        {
+            Sched_TimerStop(&sensTimers[sensor]);
+            onMeasure |= repstate == SENS_REPSTATE_THRESHOLD_EVENTS;
+            continue;
+        }
+
+        sensKeepalive = true;
+        if (interval == 0)
+        {
+            Sched_TimerStop(&sensTimers[sensor]);
+            onMeasure = true;
+        }
+        else
+        {
+            if (interval < SENSOR_MIN_INTERVAL)
+            {
+                interval = SENSOR_MIN_INTERVAL;
+                sens_feature.sensor[sensor].interval = interval;
+            }
+            sensTimers[sensor].Callback = Sensor_Due;
+            sensTimers[sensor].Arg = (void*)(uintptr_t)sensor;
+            Sched_TimerStart(&sensTimers[sensor], interval, interval);
+        }
+    }
+
+    /* Keepalive reports are only sent to sensors reporting all events */
+    if (sensKeepalive)
+    {
+        Sched_TimerStart(&sensSilence, SENSOR_MAX_SILENCE, 0);
+    }
+    else
+    {
+        Sched_TimerStop(&sensSilence);
+    }
+
+    /* Changes and thresholds are checked after each measurement */
+    Analog_SetNotification(onMeasure ? &sensWork : NULL);
+}
+
 /**
  * @brief Sends the Feature report through the control EP.
  * @param itf: callback sender interface
@@ -389,31 +901,62 @@ static void Sensor_GetReport(void* itf, USBD_HID_ReportType type, uint8_t report
 static void Sensor_SetReport(void* itf, USBD_HID_ReportType type, uint8_t * data, uint16_t length)
 {
     memcpy((uint8_t*)&sens_feature, data, length);
+
+    /* Apply the new reporting states and intervals */
+    if (sens_if->Base.Device->ConfigSelector != 0)
+    {
+        Sensor_Schedule();
+    }
 }
 
 /**
- * @brief Provides the measured input report data for transmission
+ * @brief Starts the measurements and the periodic reports
+ *        when the interface is activated.
+ * @param itf: callback sender interface
  */
-void Sensor_Periodic(void)
+static void Sensor_Init(void* itf)
 {
-    if (sens_if->Base.Device->ConfigSelector != 0)
-    {
-        static uint8_t msCounter = 0;
+    /* VDD is measured through the internal reference */
+    uint32_t channels = ADCH_MASK(ADCH_VREFINT);
 
-        if (++msCounter >= REPORT_INTERVAL)
-        {
-            Sensor_SendInput();
-            msCounter = 0;
-        }
+#ifdef SENR_TEMP
+    channels |= ADCH_MASK(ADCH_TEMP);
+#endif
+#ifdef SENR_LIGHT
+    channels |= ADCH_MASK(ADCH_LIGHT_SENSOR);
+#endif
+    Analog_SetChannels(ANALOG_USER_SENSOR, channels);
+
+    Sensor_Schedule();
+}
+
+/**
+ * @brief Releases the measurements and stops the periodic reports
+ *        when the interface is deactivated.
+ * @param itf: callback sender interface
+ */
+static void Sensor_Deinit(void* itf)
+{
+    uint8_t sensor;
+
+    Analog_SetNotification(NULL);
+    for (sensor = 0; sensor < SENS_COUNT; sensor++)
+    {
+        Sched_TimerStop(&sensTimers[sensor]);
     }
+    Sched_TimerStop(&sensSilence);
+    Sched_TimerStop(&sensRetry);
+
+    /* The measurements only stop if no other user needs them */
+    Analog_SetChannels(ANALOG_USER_SENSOR, 0);
 }
 
 /** @brief Sensors HID Application */
 const USBD_HID_AppType sensApp =
 {
     .Name       = "DebugDongle Sensor Collection",
-    .Init       = (void (*)(void*))Analog_Resume,
-    .Deinit     = (void (*)(void*))Analog_Halt,
+    .Init       = Sensor_Init,
+    .Deinit     = Sensor_Deinit,
     .SetReport  = Sensor_SetReport,
     .GetReport  = Sensor_GetReport,
     .Report     = &sensReportConfig,
@@ -32,8 +32,6 @@ extern "C"
 
 extern USBD_HID_IfHandleType *const sens_if;
 
-void Sensor_Periodic(void);
-
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,501 @@
+/**
+  ******************************************************************************
+  * @file    diag_if.c
+  * @author  Benedek Kupper
+  * @version 1.0
+  * @date    2026-10-16
+  * @brief   Diagnostics HID interface implementation
+  *
+  *  @verbatim
+  *
+  * ===================================================================
+  *                       USB Diagnostics Interface
+  * ===================================================================
+  *  This interface exposes the runtime statistics of the device
+  *  using vendor defined HID reports. The VCP statistics report
+  *  can be read as an Input report through the control endpoint,
+  *  and it is cleared by setting the matching Feature report.
+  *  The VCP self-test is started by setting the test Feature report
+  *  (mode 0 stops the ongoing test), and its results are returned
+  *  when the same Feature report is read.
+  *  The delimiter triggered flush of the VCP is configured by
+  *  the line delimiter Feature report.
+  *  The scheduler activity report provides the number of wakeups,
+  *  and their rate since the previous read of the report.
+  *  The analog sampling Feature report sets the measurement rate and
+  *  the ADC sample time, invalid settings are ignored, reading the
+  *  report returns the applied settings.
+  *  @endverbatim
+  *
+  * Copyright (c) 2026 Benedek Kupper
+  *
+  * Licensed under the Apache License, Version 2.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  *     http://www.apache.org/licenses/LICENSE-2.0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  */
+#include <diag_if.h>
+#include <vcp_if.h>
+#include <scheduler.h>
+#include <analog.h>
+
+#define REPORT_INTERVAL         100
+
+/* Vendor defined usage page and usages */
+#define HID_USAGE_PAGE_VENDOR_DIAG      0x06, 0x00, 0xFF
+#define HID_USAGE_VENDOR(ID)            0x09, (ID)
+
+extern VCP_HandleType *const vcp_handle;
+
+/** @brief HID report descriptor of diag_if */
+__alignment(USBD_DATA_ALIGNMENT)
+static const uint8_t DiagReport[] __align(USBD_DATA_ALIGNMENT) =
+{
+#if 1
+HID_USAGE_PAGE_VENDOR_DIAG,
+    HID_USAGE_VENDOR(0x01),
+    HID_COLLECTION_APPLICATION(
+
+        /* VCP statistics */
+        HID_REPORT_ID(1),
+
+        /* OUT bytes, OUT transfers, OUT full time, IN bytes,
+         * IN transfers, IN busy, IN max level, dropped bytes */
+        HID_USAGE_VENDOR(0x10),
+        HID_USAGE_VENDOR(0x11),
+        HID_USAGE_VENDOR(0x12),
+        HID_USAGE_VENDOR(0x13),
+        HID_USAGE_VENDOR(0x14),
+        HID_USAGE_VENDOR(0x15),
+        HID_USAGE_VENDOR(0x16),
+        HID_USAGE_VENDOR(0x17),
+        HID_LOGICAL_MIN_8(0),
+        HID_LOGICAL_MAX_32(0xFFFFFFFF),
+        HID_REPORT_SIZE(32),
+        HID_REPORT_COUNT(8),
+        HID_INPUT(Data_Var_Abs),
+
+        /* Line coding changes, last line switch time */
+        HID_USAGE_VENDOR(0x1B),
+        HID_USAGE_VENDOR(0x1C),
+        HID_LOGICAL_MIN_8(0),
+        HID_LOGICAL_MAX_32(0xFFFFFFFF),
+        HID_REPORT_SIZE(32),
+        HID_REPORT_COUNT(2),
+        HID_INPUT(Data_Var_Abs),
+
+        /* UART overrun, framing and parity errors */
+        HID_USAGE_VENDOR(0x18),
+        HID_USAGE_VENDOR(0x19),
+        HID_USAGE_VENDOR(0x1A),
+        HID_LOGICAL_MIN_8(0),
+        HID_LOGICAL_MAX_16(0xFFFF),
+        HID_REPORT_SIZE(16),
+        HID_REPORT_COUNT(3),
+        HID_INPUT(Data_Var_Abs),
+
+        /* Statistics reset */
+        HID_USAGE_VENDOR(0x1F),
+        HID_LOGICAL_MIN_8(0),
+        HID_LOGICAL_MAX_8(1),
+        HID_REPORT_SIZE(8),
+        HID_REPORT_COUNT(1),
+        HID_FEATURE(Data_Var_Abs),
+
+        /* VCP self-test */
+        HID_REPORT_ID(2),
+
+        /* Test mode */
+        HID_USAGE_VENDOR(0x20),
+        HID_LOGICAL_MIN_8(0),
+        HID_LOGICAL_MAX_8(VCP_TEST_ECHO),
+        HID_REPORT_SIZE(8),
+        HID_REPORT_COUNT(1),
+        HID_FEATURE(Data_Var_Abs),
+
+        /* Baudrate, duration, elapsed time, bytes, throughput,
+         * bit errors, sync losses, min, avg and max latency */
+        HID_USAGE_VENDOR(0x21),
+        HID_USAGE_VENDOR(0x22),
+        HID_USAGE_VENDOR(0x23),
+        HID_USAGE_VENDOR(0x24),
+        HID_USAGE_VENDOR(0x25),
+        HID_USAGE_VENDOR(0x26),
+        HID_USAGE_VENDOR(0x27),
+        HID_USAGE_VENDOR(0x28),
+        HID_USAGE_VENDOR(0x29),
+        HID_USAGE_VENDOR(0x2A),
+        HID_LOGICAL_MIN_8(0),
+        HID_LOGICAL_MAX_32(0xFFFFFFFF),
+        HID_REPORT_SIZE(32),
+        HID_REPORT_COUNT(10),
+        HID_FEATURE(Data_Var_Abs),
+
+        /* VCP line delimiter */
+        HID_REPORT_ID(3),
+
+        /* Enable, delimiter character */
+        HID_USAGE_VENDOR(0x30),
+        HID_USAGE_VENDOR(0x31),
+        HID_LOGICAL_MIN_8(0),
+        HID_LOGICAL_MAX_16(0xFF),
+        HID_REPORT_SIZE(8),
+        HID_REPORT_COUNT(2),
+        HID_FEATURE(Data_Var_Abs),
+
+        /* Scheduler activity */
+        HID_REPORT_ID(4),
+
+        /* Wakeups, wakeups per second, timer expiries, work items */
+        HID_USAGE_VENDOR(0x40),
+        HID_USAGE_VENDOR(0x41),
+        HID_USAGE_VENDOR(0x42),
+        HID_USAGE_VENDOR(0x43),
+        HID_LOGICAL_MIN_8(0),
+        HID_LOGICAL_MAX_32(0xFFFFFFFF),
+        HID_REPORT_SIZE(32),
+        HID_REPORT_COUNT(4),
+        HID_INPUT(Data_Var_Abs),
+
+        /* Analog sampling */
+        HID_REPORT_ID(5),
+
+        /* Measurement rate */
+        HID_USAGE_VENDOR(0x50),
+        HID_LOGICAL_MIN_8(0),
+        HID_LOGICAL_MAX_32(0xFFFF),
+        HID_REPORT_SIZE(16),
+        HID_REPORT_COUNT(1),
+        HID_FEATURE(Data_Var_Abs),
+
+        /* ADC sample time selection */
+        HID_USAGE_VENDOR(0x51),
+        HID_LOGICAL_MIN_8(0),
+        HID_LOGICAL_MAX_8(7),
+        HID_REPORT_SIZE(8),
+        HID_REPORT_COUNT(1),
+        HID_FEATURE(Data_Var_Abs),
+
+    ),
+#endif /* 1 */
+};
+
+/** @brief HID IN report #1 buffer */
+struct {
+    uint8_t id;
+    struct {
+        uint32_t outBytes;
+        uint32_t outTransfers;
+        uint32_t outFull_us;
+        uint32_t inBytes;
+        uint32_t inTransfers;
+        uint32_t inBusy;
+        uint32_t inMaxLevel;
+        uint32_t dropped;
+        uint32_t lineChanges;
+        uint32_t lineSwitch_us;
+        uint16_t overrun;
+        uint16_t framing;
+        uint16_t parity;
+    }vcp;
+}__packed diag_vcpStats __align(USBD_DATA_ALIGNMENT) = {
+    .id = 1,
+};
+
+/** @brief HID IN report #4 buffer */
+struct {
+    uint8_t id;
+    uint32_t wakeups;
+    uint32_t wakeupsPerSec;
+    uint32_t timers;
+    uint32_t works;
+}__packed diag_schedStats __align(USBD_DATA_ALIGNMENT) = {
+    .id = 4,
+};
+
+/** @brief HID Feature report #1 buffer */
+typedef struct {
+    uint8_t id;
+    uint8_t reset;
+}__packed Diag_FtVcpType;
+
+Diag_FtVcpType diag_ftVcp __align(USBD_DATA_ALIGNMENT) = {
+    .id = 1,
+    .reset = 0,
+};
+
+/** @brief HID Feature report #2 buffer */
+typedef struct {
+    uint8_t id;
+    uint8_t mode;
+    uint32_t baudrate;
+    uint32_t duration_ms;
+    uint32_t elapsed_ms;
+    uint32_t bytes;
+    uint32_t bytesPerSec;
+    uint32_t bitErrors;
+    uint32_t syncLosses;
+    uint32_t latencyMin_us;
+    uint32_t latencyAvg_us;
+    uint32_t latencyMax_us;
+}__packed Diag_FtTestType;
+
+Diag_FtTestType diag_ftTest __align(USBD_DATA_ALIGNMENT) = {
+    .id = 2,
+    .mode = VCP_TEST_OFF,
+    .baudrate = 115200,
+};
+
+/** @brief HID Feature report #3 buffer */
+typedef struct {
+    uint8_t id;
+    uint8_t enable;
+    uint8_t delimiter;
+}__packed Diag_FtMatchType;
+
+Diag_FtMatchType diag_ftMatch __align(USBD_DATA_ALIGNMENT) = {
+    .id = 3,
+};
+
+/** @brief HID Feature report #5 buffer */
+typedef struct {
+    uint8_t id;
+    uint16_t rate_Hz;
+    uint8_t sampleTime;
+}__packed Diag_FtSamplingType;
+
+Diag_FtSamplingType diag_ftSampling __align(USBD_DATA_ALIGNMENT) = {
+    .id = 5,
+};
+
+const USBD_HID_ReportConfigType diagReportConfig = {
+        .Desc = DiagReport,
+        .DescLength = sizeof(DiagReport),
+        .MaxId = 5,
+        .Input.MaxSize = sizeof(diag_vcpStats),
+        .Input.Interval_ms = REPORT_INTERVAL,
+        .Feature.MaxSize = sizeof(diag_ftTest),
+};
+
+/**
+ * @brief Updates and sends IN report #1
+ */
+static void Diag_SendVcpReport(void)
+{
+    const VCP_StatsType *stats = &vcp_handle->Stats;
+    const VCP_RxErrorsType *errors = &vcp_handle->RxErrors;
+
+    diag_vcpStats.vcp.outBytes     = stats->OutBytes;
+    diag_vcpStats.vcp.outTransfers = stats->OutTransfers;
+    diag_vcpStats.vcp.outFull_us   = stats->OutFull_us;
+    diag_vcpStats.vcp.inBytes      = stats->InBytes;
+    diag_vcpStats.vcp.inTransfers  = stats->InTransfers;
+    diag_vcpStats.vcp.inBusy       = stats->InBusy;
+    diag_vcpStats.vcp.inMaxLevel   = stats->InMaxLevel;
+    diag_vcpStats.vcp.dropped      = errors->Dropped;
+    diag_vcpStats.vcp.lineChanges  = stats->LineChanges;
+    diag_vcpStats.vcp.lineSwitch_us = stats->LineSwitch_us;
+    diag_vcpStats.vcp.overrun      = errors->Overrun;
+    diag_vcpStats.vcp.framing      = errors->Framing;
+    diag_vcpStats.vcp.parity       = errors->Parity;
+
+    USBD_HID_ReportIn(diag_if,
+                (uint8_t*)&diag_vcpStats, sizeof(diag_vcpStats));
+}
+
+/**
+ * @brief Updates and sends IN report #4
+ */
+static void Diag_SendSchedReport(void)
+{
+    static uint32_t lastWakeups = 0, lastTime_us = 0;
+    uint32_t wakeups = Sched_Stats.Wakeups;
+    uint32_t now = Sched_GetTime_us();
+
+    /* The rate is averaged since the previous report */
+    if (now != lastTime_us)
+    {
+        diag_schedStats.wakeupsPerSec = ((uint64_t)(wakeups - lastWakeups) * 1000000)
+                / (now - lastTime_us);
+    }
+    lastWakeups = wakeups;
+    lastTime_us = now;
+
+    diag_schedStats.wakeups = wakeups;
+    diag_schedStats.timers  = Sched_Stats.Timers;
+    diag_schedStats.works   = Sched_Stats.Works;
+
+    USBD_HID_ReportIn(diag_if,
+                (uint8_t*)&diag_schedStats, sizeof(diag_schedStats));
+}
+
+/**
+ * @brief Updates and sends Feature report #2
+ * @param itf: callback sender interface
+ */
+static void Diag_SendTestReport(void* itf)
+{
+    const VCP_TestType *test = &vcp_handle->Test;
+
+    diag_ftTest.mode        = test->Mode;
+    diag_ftTest.elapsed_ms  = (test->Mode != VCP_TEST_OFF) ?
+            (Sched_GetTime_us() - test->Start_us) / 1000 : test->Time_ms;
+    diag_ftTest.bytes       = test->Bytes;
+    diag_ftTest.bitErrors   = test->BitErrors;
+    diag_ftTest.syncLosses  = test->SyncLosses;
+
+    if (test->LatencyMax_us > 0)
+    {
+        /* Echo test: Bytes counts the latency measurements */
+        diag_ftTest.bytesPerSec   = 0;
+        diag_ftTest.latencyMin_us = test->LatencyMin_us;
+        diag_ftTest.latencyAvg_us = test->LatencySum_us / test->Bytes;
+        diag_ftTest.latencyMax_us = test->LatencyMax_us;
+    }
+    else
+    {
+        diag_ftTest.bytesPerSec   = (diag_ftTest.elapsed_ms > 0) ?
+                ((uint64_t)test->Bytes * 1000) / diag_ftTest.elapsed_ms : 0;
+        diag_ftTest.latencyMin_us = 0;
+        diag_ftTest.latencyAvg_us = 0;
+        diag_ftTest.latencyMax_us = 0;
+    }
+
+    USBD_HID_ReportIn(itf,
+                (uint8_t*)&diag_ftTest, sizeof(diag_ftTest));
+}
+
+/**
+ * @brief Applies the received feature report.
+ * @param itf: callback sender interface
+ * @param type: report type (here always FEATURE)
+ * @param data: report data
+ * @param length: total length of the report
+ */
+static void Diag_SetReport(void* itf, USBD_HID_ReportType type, uint8_t * data, uint16_t length)
+{
+    /* First data element is the report ID */
+    switch (data[0])
+    {
+        case 1:
+            if (((Diag_FtVcpType*)data)->reset != 0)
+            {
+                VCP_ResetStats(vcp_handle);
+            }
+            break;
+
+        case 2:
+        {
+            Diag_FtTestType *ft = (Diag_FtTestType*)data;
+
+            if (ft->mode == VCP_TEST_OFF)
+            {
+                VCP_StopTest(vcp_handle);
+            }
+            else if ((ft->mode <= VCP_TEST_ECHO) && (ft->duration_ms > 0))
+            {
+                diag_ftTest.baudrate    = ft->baudrate;
+                diag_ftTest.duration_ms = ft->duration_ms;
+                VCP_StartTest(vcp_handle, ft->mode,
+                        ft->baudrate, ft->duration_ms);
+            }
+            break;
+        }
+
+        case 3:
+        {
+            Diag_FtMatchType *ft = (Diag_FtMatchType*)data;
+
+            VCP_SetCharMatch(vcp_handle, ft->enable, ft->delimiter);
+            break;
+        }
+
+        case 5:
+        {
+            Diag_FtSamplingType *ft = (Diag_FtSamplingType*)data;
+
+            (void)Analog_SetSampling(ft->rate_Hz, ft->sampleTime);
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Returns a requested report (through the CTRL endpoint).
+ * @param itf: callback sender interface
+ * @param type: requested report's type
+ * @param reportId: The report's ID
+ */
+static void Diag_GetReport(void* itf, USBD_HID_ReportType type, uint8_t reportId)
+{
+    if (type == HID_REPORT_INPUT) switch (reportId)
+    {
+        case 1:
+            Diag_SendVcpReport();
+            break;
+        case 4:
+            Diag_SendSchedReport();
+            break;
+        default:
+            break;
+    }
+    else switch (reportId)
+    {
+        case 1:
+            USBD_HID_ReportIn(itf,
+                    (uint8_t*)&diag_ftVcp,
+                    sizeof(diag_ftVcp));
+            break;
+        case 2:
+            Diag_SendTestReport(itf);
+            break;
+        case 3:
+            diag_ftMatch.enable    = vcp_handle->MatchEnable;
+            diag_ftMatch.delimiter = vcp_handle->MatchChar;
+            USBD_HID_ReportIn(itf,
+                    (uint8_t*)&diag_ftMatch,
+                    sizeof(diag_ftMatch));
+            break;
+        case 5:
+        {
+            uint16_t rate_Hz;
+            uint8_t sampleTime;
+
+            /* The packed fields cannot be written through pointers */
+            Analog_GetSampling(&rate_Hz, &sampleTime);
+            diag_ftSampling.rate_Hz    = rate_Hz;
+            diag_ftSampling.sampleTime = sampleTime;
+            USBD_HID_ReportIn(itf,
+                    (uint8_t*)&diag_ftSampling,
+                    sizeof(diag_ftSampling));
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+/** @brief Diagnostics HID Application */
+const USBD_HID_AppType diagApp =
+{
+    .Name       = "DebugDongle Diagnostics",
+    .SetReport  = Diag_SetReport,
+    .GetReport  = Diag_GetReport,
+    .Report     = &diagReportConfig,
+};
+
+/** @brief Diagnostics HID Interface (and reference) */
+USBD_HID_IfHandleType hdiag_if = {
+    .App = &diagApp,
+    .Base.AltCount = 1,
+}, *const diag_if = &hdiag_if;
@@ -13,11 +13,52 @@
   * ===================================================================
   *  This interface implements a virtual COM port using USB CDC class
   *  and an UART peripheral of the device. The received USB packets
-  *  are transferred on UART using a 2-page buffer, one is receiving
-  *  the USB OUT endpoint data, the other is used by the UART Tx DMA.
-  *  The received UART bytes are put in a circular buffer by the Rx DMA
-  *  and are monitored by a timer callback. New received bytes are
-  *  sent over the USB IN endpoint.
+  *  are queued in a ring of packet sized segments: the USB OUT endpoint
+  *  receives into the first free segment, while the UART Tx DMA drains
+  *  the filled ones, chaining adjacent full segments into one transfer.
+  *  The OUT endpoint is only NAKed while all segments are occupied.
+  *  The received UART bytes are put in a circular buffer by the Rx DMA.
+  *  New received bytes are sent over the USB IN endpoint as soon as
+  *  the UART line becomes idle or the Rx DMA passes half of the buffer,
+  *  the timer callback only serves as a fallback.
+  *  Received data which is overwritten by the Rx DMA before it could be
+  *  sent, as well as the UART reception errors are counted and reported
+  *  to the host by CDC SERIAL_STATE notifications.
+  *
+  *  The UART clock divider is calculated for the closest achievable
+  *  baudrate, using 8x oversampling only for the rates above the reach of
+  *  16x oversampling (up to the kernel clock / 8). Requests outside the
+  *  achievable range are clamped to it, while requests that cannot be
+  *  matched within VCP_BAUDRATE_TOLERANCE keep the previous baudrate.
+  *  The applied baudrate is reported back to the host in the line coding.
+  *
+  *  Line coding changes of an open port don't reinitialize the bridge:
+  *  the OUT segments queued before the change are transmitted with the
+  *  previous settings, then only the divider and the frame format are
+  *  reprogrammed, while the Rx DMA ring keeps its unread data.
+  *
+  *  For line oriented traffic the character match interrupt of the UART
+  *  can flush the received data as soon as the configured delimiter
+  *  arrives, while bulk data is still batched into full packets.
+  *
+  *  The circular Rx buffer is a single producer, single consumer ring:
+  *  the producer is the Rx DMA, its position is the DMA counter and the
+  *  wrap counter incremented by the DMA transfer complete interrupt.
+  *  The consumer side (Index and the wraps it has read) is owned by the
+  *  flush routine, which only runs in the UART interrupt. Any other event
+  *  that requires a flush (DMA, USB, timer) pends the UART interrupt,
+  *  therefore these can have any interrupt priority.
+  *
+  *  For cable and device qualification a self-test mode is available:
+  *  the UART Tx continuously sends a PRBS-15 stream from the OUT segments
+  *  while the received stream is checked for bit errors instead of being
+  *  sent to the host. Meanwhile the USB OUT endpoint is NAKed, an already
+  *  armed OUT transfer is redirected to a separate discard buffer, so the
+  *  host data cannot overwrite the PRBS source. The loopback is either
+  *  an external TX-RX jumper or the internal connection of the half-duplex
+  *  mode. In the echo test mode the bridge operates normally, and the time
+  *  from the arrival of USB OUT data to the transmission of the looped back
+  *  UART data over USB IN is measured.
   *  @endverbatim
   *
   * Copyright (c) 2018 Benedek Kupper
@@ -36,13 +77,31 @@
   */
 #include <bsp_usart.h>
 #include <vcp_if.h>
+#include <string.h>
 
 static void VCP_Open(void* itf, USBD_CDC_LineCodingType * line);
 static void VCP_Close(void* itf);
 static void VCP_USB_ReceiveNew(void* itf, uint8_t* pbuf, uint16_t length);
 static void VCP_USB_TransmitNew(void* itf, uint8_t* pbuf, uint16_t length);
+static void VCP_USB_Transmitted(void* itf, uint8_t* pbuf, uint16_t length);
 
 static void VCP_UART_Transmitted(void * handle);
+static void VCP_UART_TransmitNext(VCP_HandleType *vcp);
+static void VCP_UART_Received(void * handle);
+static void VCP_UART_HalfReceived(void * handle);
+static void VCP_Kick(VCP_HandleType *vcp);
+static void VCP_NotifySerialState(VCP_HandleType *vcp);
+static uint32_t VCP_CalcBaudrate(uint32_t clock, uint32_t baudrate, uint16_t *brr);
+static void VCP_ChangeLineCoding(VCP_HandleType *vcp);
+static void VCP_ApplyLineCoding(VCP_HandleType *vcp);
+static void VCP_ApplyCharMatch(VCP_HandleType *vcp);
+static void VCP_TestTransmit(VCP_HandleType *vcp, uint8_t segment);
+static void VCP_TestReceive(VCP_HandleType *vcp, uint16_t length);
+static void VCP_Retry(void * arg);
+static void VCP_TestFinished(void * arg);
+
+#define VCP_IS_PRBS_TEST(VCP)   (((VCP)->Test.Mode == VCP_TEST_PRBS) || \
+                                 ((VCP)->Test.Mode == VCP_TEST_PRBS_INTERNAL))
 
 const USBD_CDC_AppType vcpApp =
 {
@@ -50,7 +109,7 @@ const USBD_CDC_AppType vcpApp =
     .Open           = VCP_Open,
     .Close          = VCP_Close,
     .Received       = VCP_USB_ReceiveNew,
-    .Transmitted    = VCP_USB_TransmitNew,
+    .Transmitted    = VCP_USB_Transmitted,
 };
 
 /**
@@ -73,7 +132,20 @@ static void VCP_Open(void* itf, USBD_CDC_LineCodingType * line)
             .HalfDuplex    = DISABLE,
     };
 
-    serialConfig.Baudrate = line->DTERate;
+    uint32_t clock, baudrate;
+    uint16_t brr;
+
+    /* Keep the previous baudrate if the request cannot be met accurately */
+    clock = USART_ulClockFreq_Hz(&vcp->Uart);
+    baudrate = VCP_CalcBaudrate(clock, line->DTERate, &brr);
+    if (baudrate == 0)
+    {
+        baudrate = VCP_CalcBaudrate(clock, serialConfig.Baudrate, &brr);
+    }
+    line->DTERate = baudrate;
+
+    serialConfig.Baudrate = baudrate;
+    serialConfig.OverSampling8 = (baudrate > clock / 16) ? ENABLE : DISABLE;
     serialConfig.DataSize = line->DataBits;
 
     /* set the Stop bit */
@@ -100,23 +172,79 @@ static void VCP_Open(void* itf, USBD_CDC_LineCodingType * line)
             break;
     }
 
+    /* In half-duplex mode the transmitted data is received internally */
+    serialConfig.HalfDuplex = (vcp->Test.Mode == VCP_TEST_PRBS_INTERNAL) ? ENABLE : DISABLE;
+
+    /* A running bridge only needs its frame format changed */
+    if ((USART_REG_BIT(&vcp->Uart, CR1, UE) != 0) && !VCP_IS_PRBS_TEST(vcp) &&
+        (line->DataBits >= 7) && (line->DataBits <= 8))
+    {
+        VCP_ChangeLineCoding(vcp);
+        return;
+    }
+
     /* Initialize UART with the current configuration, reset DMAs */
     USART_vInitAsync(&vcp->Uart, &serialConfig);
+
+    /* Apply the exact divider, it is only writable while disabled */
+    USART_DISABLE(&vcp->Uart);
+    vcp->Uart.Inst->BRR.w = brr;
+    USART_ENABLE(&vcp->Uart);
+
     DMA_vStop(vcp->Uart.DMA.Transmit);
     DMA_vStop(vcp->Uart.DMA.Receive);
 
     /* Subscribe to UART transmit complete callback */
     vcp->Uart.Callbacks.Transmit = VCP_UART_Transmitted;
 
-    /* Page 0 is initialized for OUT endpoint reception */
-    vcp->OutStatus[0] = VCP_BUFFER_RECEIVING;
-    vcp->OutStatus[1] = VCP_BUFFER_EMPTY;
-    (void) USBD_CDC_Receive(itf, vcp->OutData[0], VCP_OUT_DATA_SIZE / 2);
+    /* Busy USB endpoints are retried by timer */
+    vcp->RetryTimer.Callback = VCP_Retry;
+    vcp->RetryTimer.Arg = vcp;
+
+    /* The segment queue is emptied, the first segment receives OUT data */
+    vcp->OutHead    = 0;
+    vcp->OutTail    = 0;
+    vcp->OutCount   = 0;
+    vcp->OutTxCount = 0;
+    vcp->OutDrain   = 0;
+    vcp->LineChange = 0;
+    if (!VCP_IS_PRBS_TEST(vcp))
+    {
+        (void) USBD_CDC_Receive(itf, vcp->OutData[0], VCP_OUT_SEGMENT_SIZE);
+    }
+
+    /* Subscribe to UART receive half and full buffer callbacks */
+    vcp->Uart.Callbacks.Receive = VCP_UART_Received;
+    vcp->Uart.DMA.Receive->Callbacks.HalfComplete = VCP_UART_HalfReceived;
 
     /* Start circular buffer reception with DMA for IN endpoint */
     vcp->Index = 0;
+    vcp->InLength = 0;
+    vcp->InWraps = 0;
+    vcp->InWrapsRead = 0;
     USART_FLAG_CLEAR(&vcp->Uart, RXNE);
     (void) USART_eReceive_DMA(&vcp->Uart, vcp->InData, VCP_IN_DATA_SIZE);
+    DMA_IT_ENABLE(vcp->Uart.DMA.Receive, HT);
+
+    /* The end of a reception burst is signalled by the idle line interrupt */
+    USART_FLAG_CLEAR(&vcp->Uart, IDLE);
+    USART_IT_ENABLE(&vcp->Uart, IDLE);
+
+    /* Reception errors are signalled by interrupt */
+    USART_IT_ENABLE(&vcp->Uart, PE);
+    USART_REG_BIT(&vcp->Uart, CR3, EIE) = 1;
+
+    /* The end of a line is signalled by the character match interrupt */
+    if (vcp->MatchEnable != 0)
+    {
+        VCP_ApplyCharMatch(vcp);
+    }
+
+    /* The self-test stream is started once the reception is running */
+    if (VCP_IS_PRBS_TEST(vcp))
+    {
+        VCP_TestTransmit(vcp, 0);
+    }
 }
 
 /**
@@ -129,6 +257,129 @@ static void VCP_Close(void* itf)
     USART_vDeinit(&vcp->Uart);
 }
 
+/**
+ * @brief  Calculates the UART clock divider for the closest achievable baudrate.
+ *         With 16x oversampling the baudrate is fck / USARTDIV, USARTDIV >= 16.
+ *         Above fck / 16 the 8x oversampling is used, which has half steps:
+ *         the baudrate is 2 * fck / USARTDIV, 16 <= USARTDIV < 32.
+ * @param  clock: the UART kernel clock frequency
+ * @param  baudrate: the requested baudrate, clamped to the achievable range
+ * @param  brr: the calculated BRR register value
+ * @return The achieved baudrate, or 0 if its error exceeds the tolerance
+ */
+static uint32_t VCP_CalcBaudrate(uint32_t clock, uint32_t baudrate, uint16_t *brr)
+{
+    uint32_t div, div2, achieved, error;
+
+    if (baudrate > clock / 8)
+    {
+        baudrate = clock / 8;
+    }
+    else if (baudrate < (clock + 0xFFFE) / 0xFFFF)
+    {
+        baudrate = (clock + 0xFFFE) / 0xFFFF;
+    }
+
+    div2 = (2 * clock + baudrate / 2) / baudrate;
+    if (div2 >= 32)
+    {
+        div = (clock + baudrate / 2) / baudrate;
+        achieved = (clock + div / 2) / div;
+    }
+    else
+    {
+        div = div2;
+        achieved = (2 * clock + div / 2) / div;
+    }
+    error = (achieved > baudrate) ? (achieved - baudrate) : (baudrate - achieved);
+
+    if (error > (((uint64_t)baudrate * VCP_BAUDRATE_TOLERANCE) / 1000))
+    {
+        return 0;
+    }
+
+    if (div2 >= 32)
+    {
+        *brr = div;
+    }
+    else
+    {
+        /* With 8x oversampling the 4 LSBs are shifted right by 1 */
+        *brr = (div & 0xFFF0) | ((div & 0xF) >> 1);
+    }
+    return achieved;
+}
+
+/**
+ * @brief  Requests or continues a line coding change of the running bridge.
+ *         The change is applied once the segments queued before the request
+ *         are transmitted, and the last character has left the shift register.
+ * @param  vcp: VCP handle
+ */
+static void VCP_ChangeLineCoding(VCP_HandleType *vcp)
+{
+    /* Consecutive requests are served by the same change */
+    if (vcp->LineChange == 0)
+    {
+        vcp->LineChange = 1;
+        vcp->LineChangeStart_us = Sched_GetTime_us();
+        vcp->OutDrain = vcp->OutCount;
+    }
+
+    /* Until the queued segments are sent, VCP_UART_Transmitted continues */
+    if (vcp->OutDrain == 0)
+    {
+        if (USART_FLAG_STATUS(&vcp->Uart, TC) != 0)
+        {
+            VCP_ApplyLineCoding(vcp);
+        }
+        else
+        {
+            /* Wait for the transmission complete interrupt */
+            USART_IT_ENABLE(&vcp->Uart, TC);
+        }
+    }
+}
+
+/**
+ * @brief  Reprograms the baudrate and frame format of the idle transmitter
+ *         according to the current line coding, then resumes transmission.
+ *         The Rx DMA requests are paused while the UART is disabled,
+ *         the ring buffer content is not affected.
+ * @param  vcp: VCP handle
+ */
+static void VCP_ApplyLineCoding(VCP_HandleType *vcp)
+{
+    USBD_CDC_LineCodingType *line = &vcp->CdcIf.LineCoding;
+    uint32_t clock = USART_ulClockFreq_Hz(&vcp->Uart);
+    uint8_t parity = ((line->ParityType == 1) || (line->ParityType == 2)) ? 1 : 0;
+    uint8_t frame = line->DataBits + parity;
+    uint16_t brr;
+
+    (void) VCP_CalcBaudrate(clock, line->DTERate, &brr);
+
+    /* These settings are only writable while the UART is disabled */
+    USART_DISABLE(&vcp->Uart);
+    vcp->Uart.Inst->BRR.w = brr;
+    USART_REG_BIT(&vcp->Uart, CR1, OVER8) = (line->DTERate > clock / 16) ? 1 : 0;
+    USART_REG_BIT(&vcp->Uart, CR1, M1)    = (frame == 7) ? 1 : 0;
+    USART_REG_BIT(&vcp->Uart, CR1, M0)    = (frame == 9) ? 1 : 0;
+    USART_REG_BIT(&vcp->Uart, CR1, PCE)   = parity;
+    USART_REG_BIT(&vcp->Uart, CR1, PS)    = (line->ParityType == 1) ? 1 : 0;
+    USART_REG_BIT(&vcp->Uart, CR2, STOP)  = (line->CharFormat == 2) ? 2 : 0;
+    USART_ENABLE(&vcp->Uart);
+
+    vcp->LineChange = 0;
+    vcp->Stats.LineChanges++;
+    vcp->Stats.LineSwitch_us = Sched_GetTime_us() - vcp->LineChangeStart_us;
+
+    /* Transmit the segments received since the request */
+    if (vcp->OutCount > 0)
+    {
+        VCP_UART_TransmitNext(vcp);
+    }
+}
+
 /**
  * @brief  Data received over USB OUT endpoint are sent over UART by this function.
  * @param  itf: callback sender interface
@@ -138,53 +389,171 @@ static void VCP_Close(void* itf)
 static void VCP_USB_ReceiveNew(void* itf, uint8_t * pbuf, uint16_t length)
 {
     VCP_HandleType *vcp = container_of(itf, VCP_HandleType, CdcIf);
-    uint8_t page = (vcp->OutStatus[0] == VCP_BUFFER_RECEIVING) ? 0 : 1;
 
-    /* If UART transmission is ongoing on other page */
-    if (vcp->OutStatus[1 - page] == VCP_BUFFER_TRANSMITTING)
+    /* The segments are the PRBS source during the self-test, the packet
+     * of the discard buffer is dropped, and the OUT endpoint is NAKed
+     * until the bridge is reopened */
+    if (VCP_IS_PRBS_TEST(vcp) || (pbuf == vcp->OutDiscard))
     {
-        /* Just indicate buffer status */
-        vcp->OutStatus[page] = VCP_BUFFER_FULL;
-        vcp->OutLength       = length;
+        return;
+    }
+
+    /* Empty packets carry no data, the same segment can be reused */
+    if (length > 0)
+    {
+        vcp->Stats.OutBytes += length;
+        vcp->Stats.OutTransfers++;
+
+        if ((vcp->Test.Mode == VCP_TEST_ECHO) && (vcp->Test.EchoPending == 0))
+        {
+            vcp->Test.EchoStart_us = Sched_GetTime_us();
+            vcp->Test.EchoPending = 1;
+        }
+
+        /* Queue the received segment */
+        vcp->OutLength[vcp->OutHead] = length;
+        vcp->OutCount++;
+        if (++vcp->OutHead >= VCP_OUT_SEGMENT_COUNT)
+        {
+            vcp->OutHead = 0;
+        }
+
+        /* Start UART transmission if it's idle,
+         * and not held back by a line coding change */
+        if ((vcp->OutTxCount == 0) && (vcp->LineChange == 0))
+        {
+            VCP_UART_TransmitNext(vcp);
+        }
+    }
+
+    /* Continue reception if there is a free segment,
+     * otherwise the OUT endpoint is NAKed until one is transmitted */
+    if (vcp->OutCount < VCP_OUT_SEGMENT_COUNT)
+    {
+        (void) USBD_CDC_Receive(itf, vcp->OutData[vcp->OutHead], VCP_OUT_SEGMENT_SIZE);
     }
     else
     {
-        /* Switch pages, start transfer on both */
-        vcp->OutStatus[page] = VCP_BUFFER_TRANSMITTING;
-        (void) USART_eTransmit_DMA(&vcp->Uart, vcp->OutData[page], length);
+        vcp->OutFullStart_us = Sched_GetTime_us();
+    }
+}
 
-        vcp->OutStatus[1 - page] = VCP_BUFFER_RECEIVING;
-        (void) USBD_CDC_Receive(itf, vcp->OutData[1 - page], VCP_OUT_DATA_SIZE / 2);
+/**
+ * @brief  This function starts the UART transmission of the oldest received segments.
+ *         Full segments which are adjacent in memory are transmitted in a single transfer.
+ * @param  vcp: VCP handle
+ */
+static void VCP_UART_TransmitNext(VCP_HandleType *vcp)
+{
+    uint8_t segment = vcp->OutTail;
+    uint8_t count = (vcp->OutDrain > 0) ? vcp->OutDrain : vcp->OutCount;
+    uint16_t length = 0;
+
+    /* Segments queued after a line coding change are sent separately */
+    do
+    {
+        length += vcp->OutLength[segment];
+        vcp->OutTxCount++;
     }
+    while ((vcp->OutLength[segment] == VCP_OUT_SEGMENT_SIZE) &&
+           (++segment < VCP_OUT_SEGMENT_COUNT) &&
+           (vcp->OutTxCount < count));
+
+    (void) USART_eTransmit_DMA(&vcp->Uart, vcp->OutData[vcp->OutTail], length);
 }
 
 /**
- * @brief  This function starts new UART transmission and USB reception
- *         if a full transmit buffer is available.
- * @param  handle: unused
+ * @brief  This function releases the transmitted segments, resumes USB reception
+ *         if it was stalled, and starts the UART transmission of the next segments.
+ * @param  handle: UART handle
  */
 static void VCP_UART_Transmitted(void * handle)
 {
     VCP_HandleType *vcp = container_of(handle, VCP_HandleType, Uart);
-    uint8_t page = (vcp->OutStatus[0] == VCP_BUFFER_TRANSMITTING) ? 0 : 1;
+    bool stalled = vcp->OutCount == VCP_OUT_SEGMENT_COUNT;
 
-    /* The current page has been transferred over UART */
-    vcp->OutStatus[page] = VCP_BUFFER_EMPTY;
+    if (VCP_IS_PRBS_TEST(vcp))
+    {
+        /* Continue with the other half of the segments */
+        VCP_TestTransmit(vcp, VCP_OUT_SEGMENT_COUNT / 2 - vcp->OutTail);
+        return;
+    }
 
-    /* If other page is full already */
-    if (vcp->OutStatus[1 - page] == VCP_BUFFER_FULL)
+    /* Release the transmitted segments */
+    vcp->OutCount -= vcp->OutTxCount;
+    vcp->OutTail  += vcp->OutTxCount;
+    if (vcp->OutTail >= VCP_OUT_SEGMENT_COUNT)
     {
-        /* Switch pages, start transfer on both */
-        vcp->OutStatus[1 - page] = VCP_BUFFER_TRANSMITTING;
-        (void) USART_eTransmit_DMA(handle, vcp->OutData[1 - page], vcp->OutLength);
+        vcp->OutTail -= VCP_OUT_SEGMENT_COUNT;
+    }
+    vcp->OutDrain  -= (vcp->OutDrain > vcp->OutTxCount) ? vcp->OutTxCount : vcp->OutDrain;
+    vcp->OutTxCount = 0;
 
-        vcp->OutStatus[page] = VCP_BUFFER_RECEIVING;
-        (void) USBD_CDC_Receive(&vcp->CdcIf, vcp->OutData[page], VCP_OUT_DATA_SIZE / 2);
+    /* Re-arm the OUT endpoint as soon as a segment becomes free */
+    if (stalled)
+    {
+        vcp->Stats.OutFull_us += Sched_GetTime_us() - vcp->OutFullStart_us;
+        (void) USBD_CDC_Receive(&vcp->CdcIf, vcp->OutData[vcp->OutHead], VCP_OUT_SEGMENT_SIZE);
     }
+
+    /* The old settings are no longer needed, the transmission
+     * continues after the line coding change */
+    if ((vcp->LineChange != 0) && (vcp->OutDrain == 0))
+    {
+        VCP_ChangeLineCoding(vcp);
+        return;
+    }
+
+    /* Continue with the queued segments */
+    if (vcp->OutCount > 0)
+    {
+        VCP_UART_TransmitNext(vcp);
+    }
+}
+
+/**
+ * @brief  This function transmits the received UART data over USB
+ *         when the Rx DMA reaches the end of the circular buffer.
+ * @param  handle: UART handle
+ */
+static void VCP_UART_Received(void * handle)
+{
+    VCP_HandleType *vcp = container_of(handle, VCP_HandleType, Uart);
+
+    vcp->InWraps++;
+    VCP_Kick(vcp);
+}
+
+/**
+ * @brief  This function transmits the received UART data over USB
+ *         when the Rx DMA reaches the middle of the circular buffer.
+ * @param  handle: UART Rx DMA handle
+ */
+static void VCP_UART_HalfReceived(void * handle)
+{
+    VCP_HandleType *vcp = container_of(((DMA_HandleType*)handle)->Owner, VCP_HandleType, Uart);
+
+    VCP_Kick(vcp);
+}
+
+/**
+ * @brief  Requests the transmission of the received UART data over USB.
+ *         The flush is performed in the UART interrupt context,
+ *         so this function can be called from any interrupt priority.
+ * @param  vcp: VCP handle
+ */
+static void VCP_Kick(VCP_HandleType *vcp)
+{
+    NVIC_SetPendingIRQ(VCP_UART_IRQn);
 }
 
 /**
  * @brief  This function transmits recently received UART data over USB.
+ *         When the data wraps around the end of the circular buffer,
+ *         the two segments are transmitted in full packets, the packet
+ *         containing the wrap is assembled in a separate buffer.
+ *         This is the consumer of the Rx ring, it must only be called
+ *         from @ref VCP_IRQHandler, other contexts use @ref VCP_Kick.
  * @param  itf: callback sender interface
  * @param  pbuf: unused
  * @param  length: unused
@@ -192,39 +561,478 @@ static void VCP_UART_Transmitted(void * handle)
 static void VCP_USB_TransmitNew(void* itf, uint8_t * pbuf, uint16_t length)
 {
     VCP_HandleType *vcp = container_of(itf, VCP_HandleType, CdcIf);
-    /* Determine the buffer index of the UART DMA */
-    uint16_t rxIndex = VCP_IN_DATA_SIZE - DMA_usGetStatus(vcp->Uart.DMA.Receive);
+    uint16_t rxIndex;
+    uint8_t wraps, wrapped;
+    int8_t laps;
+    int32_t pending;
+    uint16_t nextIndex;
+    uint8_t *data;
+
+    /* Take a consistent snapshot of the producer position,
+     * retry if the DMA interrupt has updated it in the meantime */
+    do
+    {
+        wraps   = vcp->InWraps;
+        rxIndex = VCP_IN_DATA_SIZE - DMA_usGetStatus(vcp->Uart.DMA.Receive);
+        wrapped = DMA_FLAG_STATUS(vcp->Uart.DMA.Receive, TC);
+    }
+    while (wraps != vcp->InWraps);
+    laps = (int8_t)(uint8_t)(wraps - vcp->InWrapsRead);
+
+    /* The DMA has wrapped, but its interrupt hasn't been handled yet */
+    if ((wrapped != 0) && (rxIndex < (VCP_IN_DATA_SIZE / 2)))
+    {
+        laps++;
+    }
+    pending = (int32_t)laps * VCP_IN_DATA_SIZE + rxIndex - vcp->Index;
 
-    /* If the UART RX index is ahead, transmit the new data */
-    if (vcp->Index < rxIndex)
+    /* If the DMA has overwritten unsent data, skip to the newer half of the buffer */
+    if (pending > VCP_IN_DATA_SIZE)
     {
-        if(USBD_E_OK == USBD_CDC_Transmit(itf,
-                &vcp->InData[vcp->Index], rxIndex - vcp->Index))
+        vcp->RxErrors.Dropped += pending - (VCP_IN_DATA_SIZE / 2);
+        pending = VCP_IN_DATA_SIZE / 2;
+
+        if (rxIndex >= (VCP_IN_DATA_SIZE / 2))
+        {
+            vcp->Index = rxIndex - (VCP_IN_DATA_SIZE / 2);
+            vcp->InWrapsRead += laps;
+        }
+        else
         {
-            vcp->Index = rxIndex;
+            vcp->Index = rxIndex + (VCP_IN_DATA_SIZE / 2);
+            vcp->InWrapsRead += laps - 1;
         }
+
+        vcp->SerialState.b.OverRun = 1;
+        VCP_NotifySerialState(vcp);
+    }
+
+    if (vcp->Stats.InMaxLevel < pending)
+    {
+        vcp->Stats.InMaxLevel = pending;
+    }
+
+    /* The self-test consumes the received data */
+    if (VCP_IS_PRBS_TEST(vcp))
+    {
+        VCP_TestReceive(vcp, pending);
+        return;
+    }
+
+    /* Wait for the completion of the ongoing transfer */
+    if ((vcp->InLength != 0) || (pending == 0))
+    {
+        return;
+    }
+
+    data = &vcp->InData[vcp->Index];
+    length = VCP_IN_DATA_SIZE - vcp->Index;
+
+    /* If the new data is contiguous, transmit all of it */
+    if (pending <= length)
+    {
+        length = pending;
+        nextIndex = vcp->Index + length;
     }
-    /* If the USB IN index is ahead, the buffer has wrapped, transmit until the end */
-    else if (vcp->Index > rxIndex)
+    /* If the buffer has wrapped and the end is made of full packets,
+     * transmit until the end, the rest is chained on completion */
+    else if ((length % VCP_PACKET_SIZE) == 0)
     {
-        if (USBD_E_OK == USBD_CDC_Transmit(itf,
-                &vcp->InData[vcp->Index], VCP_IN_DATA_SIZE - vcp->Index))
+        nextIndex = VCP_IN_DATA_SIZE;
+    }
+    else if (length > VCP_PACKET_SIZE)
+    {
+        /* Transmit the full packets until the end */
+        length -= length % VCP_PACKET_SIZE;
+        nextIndex = vcp->Index + length;
+    }
+    else
+    {
+        /* Fill a packet with the end and the beginning of the buffer */
+        nextIndex = VCP_PACKET_SIZE - length;
+        if (nextIndex > (pending - length))
         {
-            vcp->Index = 0;
+            nextIndex = pending - length;
         }
+        memcpy(&vcp->InGather[0], data, length);
+        memcpy(&vcp->InGather[length], &vcp->InData[0], nextIndex);
+
+        data = vcp->InGather;
+        length += nextIndex;
+        nextIndex += VCP_IN_DATA_SIZE;
+    }
+
+    if (USBD_E_OK == USBD_CDC_Transmit(itf, data, length))
+    {
+        vcp->InLength = length;
+        vcp->Stats.InBytes += length;
+        vcp->Stats.InTransfers++;
+
+        if (vcp->Test.EchoPending != 0)
+        {
+            uint32_t latency = Sched_GetTime_us() - vcp->Test.EchoStart_us;
+
+            if (latency < vcp->Test.LatencyMin_us)
+            {
+                vcp->Test.LatencyMin_us = latency;
+            }
+            if (latency > vcp->Test.LatencyMax_us)
+            {
+                vcp->Test.LatencyMax_us = latency;
+            }
+            vcp->Test.LatencySum_us += latency;
+            vcp->Test.Bytes++;
+            vcp->Test.EchoPending = 0;
+        }
+
+        /* The index follows the DMA to the next lap */
+        if (nextIndex >= VCP_IN_DATA_SIZE)
+        {
+            nextIndex -= VCP_IN_DATA_SIZE;
+            vcp->InWrapsRead++;
+        }
+        vcp->Index = nextIndex;
+    }
+    else
+    {
+        vcp->Stats.InBusy++;
+        Sched_TimerStart(&vcp->RetryTimer, 1, 0);
     }
 }
 
 /**
- * @brief  This function should be called periodically from timer callback.
- *         It requests new USB IN transfer if new UART data has been received.
+ * @brief  This function chains the next USB IN transfer
+ *         to the completed one.
+ * @param  itf: callback sender interface
+ * @param  pbuf: unused
+ * @param  length: unused
  */
-void VCP_Periodic(VCP_HandleType *vcp)
+static void VCP_USB_Transmitted(void* itf, uint8_t * pbuf, uint16_t length)
 {
-    if (vcp->CdcIf.LineCoding.DataBits != 0)
+    VCP_HandleType *vcp = container_of(itf, VCP_HandleType, CdcIf);
+
+    vcp->InLength = 0;
+    VCP_Kick(vcp);
+}
+
+/**
+ * @brief  This function sends the pending serial state notification to the host.
+ *         If the notification endpoint is busy, it is retried periodically.
+ * @param  vcp: VCP handle
+ */
+static void VCP_NotifySerialState(VCP_HandleType *vcp)
+{
+    USBD_CDC_SerialStateType state;
+    uint32_t primask = __get_PRIMASK();
+
+    /* The error bits are only reported once per occurrence,
+     * the UART interrupt can set new ones meanwhile */
+    __disable_irq();
+    state.w = vcp->SerialState.w;
+    vcp->SerialState.w = 0;
+    __set_PRIMASK(primask);
+
+    if (USBD_E_OK != USBD_CDC_NotifySerialState(&vcp->CdcIf, state))
+    {
+        __disable_irq();
+        vcp->SerialState.w |= state.w;
+        __set_PRIMASK(primask);
+
+        Sched_TimerStart(&vcp->RetryTimer, 1, 0);
+    }
+}
+
+/**
+ * @brief  This function handles the UART interrupts of the VCP.
+ *         The received data is sent over USB from this context only,
+ *         when the UART line becomes idle, or when requested by VCP_Kick().
+ *         Reception errors are counted and reported to the host.
+ * @param  vcp: VCP handle
+ */
+void VCP_IRQHandler(VCP_HandleType *vcp)
+{
+    if (USART_FLAG_STATUS(&vcp->Uart, ORE) != 0)
+    {
+        USART_FLAG_CLEAR(&vcp->Uart, ORE);
+        vcp->RxErrors.Overrun++;
+        vcp->SerialState.b.OverRun = 1;
+    }
+    if (USART_FLAG_STATUS(&vcp->Uart, FE) != 0)
+    {
+        USART_FLAG_CLEAR(&vcp->Uart, FE);
+        vcp->RxErrors.Framing++;
+        vcp->SerialState.b.Framing = 1;
+    }
+    if (USART_FLAG_STATUS(&vcp->Uart, PE) != 0)
+    {
+        USART_FLAG_CLEAR(&vcp->Uart, PE);
+        vcp->RxErrors.Parity++;
+        vcp->SerialState.b.Parity = 1;
+    }
+    if (vcp->SerialState.w != 0)
+    {
+        VCP_NotifySerialState(vcp);
+    }
+
+    /* The last character is shifted out, the line coding can be changed */
+    if ((vcp->LineChange != 0) && (vcp->OutTxCount == 0) &&
+        (USART_REG_BIT(&vcp->Uart, CR1, TCIE) != 0) &&
+        (USART_FLAG_STATUS(&vcp->Uart, TC) != 0))
+    {
+        USART_IT_DISABLE(&vcp->Uart, TC);
+        VCP_ApplyLineCoding(vcp);
+    }
+
+    if (USART_FLAG_STATUS(&vcp->Uart, CMF) != 0)
+    {
+        USART_FLAG_CLEAR(&vcp->Uart, CM);
+    }
+
+    /* The end of a burst or a line is handled by the flush below */
+    if (USART_FLAG_STATUS(&vcp->Uart, IDLE) != 0)
+    {
+        USART_FLAG_CLEAR(&vcp->Uart, IDLE);
+    }
+
+    /* Let the driver handle the rest of the UART events */
+    USART_vIRQHandler(&vcp->Uart);
+
+    /* Transmit the received UART data, as requested by the
+     * UART events or by VCP_Kick() from other contexts */
+    if ((vcp->CdcIf.LineCoding.DataBits != 0) || VCP_IS_PRBS_TEST(vcp))
     {
-        /* Transmit the received UART data periodically */
         VCP_USB_TransmitNew(&vcp->CdcIf, NULL, 0);
     }
 }
 
+/**
+ * @brief  This function retries the USB transfers that were rejected
+ *         as the endpoints were busy.
+ * @param  arg: VCP handle
+ */
+static void VCP_Retry(void * arg)
+{
+    VCP_HandleType *vcp = arg;
+
+    if (vcp->CdcIf.LineCoding.DataBits != 0)
+    {
+        VCP_Kick(vcp);
+
+        if (vcp->SerialState.w != 0)
+        {
+            VCP_NotifySerialState(vcp);
+        }
+    }
+}
+
+/**
+ * @brief  Programs the character match detection of the UART
+ *         according to the VCP settings.
+ * @param  vcp: VCP handle
+ */
+static void VCP_ApplyCharMatch(VCP_HandleType *vcp)
+{
+    USART_IT_DISABLE(&vcp->Uart, CM);
+
+    /* The match character is only writable while the receiver is disabled */
+    USART_REG_BIT(&vcp->Uart, CR1, RE) = 0;
+    USART_REG_BIT(&vcp->Uart, CR2, ADD) = vcp->MatchChar;
+    USART_REG_BIT(&vcp->Uart, CR1, RE) = 1;
+
+    USART_FLAG_CLEAR(&vcp->Uart, CM);
+    if (vcp->MatchEnable != 0)
+    {
+        USART_IT_ENABLE(&vcp->Uart, CM);
+    }
+}
+
+/**
+ * @brief  Configures the flush of the received data on a delimiter character.
+ * @param  vcp: VCP handle
+ * @param  Enable: nonzero to flush the received data when Character arrives
+ * @param  Character: the delimiter character, e.g. '\n'
+ */
+void VCP_SetCharMatch(VCP_HandleType *vcp, uint8_t Enable, uint8_t Character)
+{
+    vcp->MatchEnable = Enable;
+    vcp->MatchChar   = Character;
+
+    /* Otherwise applied when the port is opened */
+    if (USART_REG_BIT(&vcp->Uart, CR1, UE) != 0)
+    {
+        VCP_ApplyCharMatch(vcp);
+    }
+}
+
+/**
+ * @brief  Clears the statistics and the error counters of the VCP.
+ * @param  vcp: VCP handle
+ */
+void VCP_ResetStats(VCP_HandleType *vcp)
+{
+    memset(&vcp->Stats, 0, sizeof(vcp->Stats));
+    memset(&vcp->RxErrors, 0, sizeof(vcp->RxErrors));
+}
+
+
+/**
+ * @brief  Fills half of the OUT segments with the PRBS stream,
+ *         and starts their transmission over UART.
+ * @param  vcp: VCP handle
+ * @param  segment: the first segment of the half to transmit
+ */
+static void VCP_TestTransmit(VCP_HandleType *vcp, uint8_t segment)
+{
+    uint8_t *data = vcp->OutData[segment];
+    uint16_t length = (VCP_OUT_SEGMENT_COUNT / 2) * VCP_OUT_SEGMENT_SIZE;
+    uint16_t state = vcp->Test.TxState;
+    uint16_t i;
+
+    /* PRBS-15 (x^15 + x^14 + 1) is generated bytewise:
+     * the state holds the last 15 bits of the stream, the oldest in bit 0 */
+    for (i = 0; i < length; i++)
+    {
+        uint8_t byte = (uint8_t)(state ^ (state >> 1));
+        state = (state >> 8) | ((uint16_t)byte << 7);
+        data[i] = byte;
+    }
+    vcp->Test.TxState = state;
+
+    vcp->OutTail = segment;
+    (void) USART_eTransmit_DMA(&vcp->Uart, data, length);
+}
+
+/**
+ * @brief  Checks the received PRBS stream and releases the buffer space.
+ *         A byte with more than 2 bit errors is treated as the loss of
+ *         synchronization, and the checker reloads its state from the stream.
+ * @param  vcp: VCP handle
+ * @param  length: the amount of received data
+ */
+static void VCP_TestReceive(VCP_HandleType *vcp, uint16_t length)
+{
+    uint16_t state = vcp->Test.RxState;
+
+    vcp->Test.Bytes += length;
+
+    for (; length > 0; length--)
+    {
+        uint8_t byte = vcp->InData[vcp->Index];
+
+        if (vcp->Test.RxSync > 0)
+        {
+            /* Load the checker state from the stream */
+            vcp->Test.RxSync--;
+        }
+        else
+        {
+            uint8_t errors = 0;
+            uint8_t diff = byte ^ (uint8_t)(state ^ (state >> 1));
+
+            for (; diff != 0; diff &= diff - 1)
+            {
+                errors++;
+            }
+
+            if (errors > 2)
+            {
+                vcp->Test.SyncLosses++;
+                vcp->Test.RxSync = 1;
+            }
+            else
+            {
+                /* Keep the checker locked to the expected stream */
+                vcp->Test.BitErrors += errors;
+                byte = (uint8_t)(state ^ (state >> 1));
+            }
+        }
+        state = (state >> 8) | ((uint16_t)byte << 7);
+
+        if (++vcp->Index >= VCP_IN_DATA_SIZE)
+        {
+            vcp->Index = 0;
+            vcp->InWrapsRead++;
+        }
+    }
+    vcp->Test.RxState = state;
+}
+
+/**
+ * @brief  Starts a self-test of the VCP. The results are available
+ *         in the Test field of the handle.
+ * @param  vcp: VCP handle
+ * @param  Mode: the self-test mode
+ * @param  Baudrate: the UART baudrate for the PRBS tests
+ * @param  Duration_ms: the length of the test
+ */
+void VCP_StartTest(VCP_HandleType *vcp, VCP_TestModeType Mode,
+        uint32_t Baudrate, uint32_t Duration_ms)
+{
+    /* The timer of a restarted test must be unlinked before clearing */
+    Sched_TimerStop(&vcp->Test.Timer);
+
+    memset(&vcp->Test, 0, sizeof(vcp->Test));
+    vcp->Test.LatencyMin_us = UINT32_MAX;
+    vcp->Test.Duration_ms = Duration_ms;
+    vcp->Test.TxState = 0x7FFF;
+    vcp->Test.RxSync = 2;
+    vcp->Test.Mode = Mode;
+    vcp->Test.Start_us = Sched_GetTime_us();
+    vcp->Test.Timer.Callback = VCP_TestFinished;
+    vcp->Test.Timer.Arg = vcp;
+    Sched_TimerStart(&vcp->Test.Timer, Duration_ms, 0);
+
+    if (VCP_IS_PRBS_TEST(vcp))
+    {
+        USBD_CDC_LineCodingType line = {
+            .DTERate    = Baudrate,
+            .CharFormat = 0,
+            .ParityType = 0,
+            .DataBits   = 8,
+        };
+        /* The OUT transfer armed into a segment is redirected, as the
+         * USB stack would copy the host data over the PRBS stream */
+        (void) USBD_CDC_Receive(&vcp->CdcIf, vcp->OutDiscard, VCP_OUT_SEGMENT_SIZE);
+
+        /* The bridge is reinitialized for the test stream */
+        VCP_Close(&vcp->CdcIf);
+        VCP_Open(&vcp->CdcIf, &line);
+    }
+}
+
+/**
+ * @brief  Stops the ongoing self-test of the VCP, and restores
+ *         the USB-UART bridge operation.
+ * @param  vcp: VCP handle
+ */
+void VCP_StopTest(VCP_HandleType *vcp)
+{
+    bool prbs = VCP_IS_PRBS_TEST(vcp);
+
+    if (vcp->Test.Mode == VCP_TEST_OFF)
+    {
+        return;
+    }
+    Sched_TimerStop(&vcp->Test.Timer);
+    vcp->Test.Time_ms = (Sched_GetTime_us() - vcp->Test.Start_us) / 1000;
+    vcp->Test.Mode = VCP_TEST_OFF;
+
+    /* The echo test doesn't change the UART configuration */
+    if (prbs)
+    {
+        VCP_Close(&vcp->CdcIf);
+        if (vcp->CdcIf.LineCoding.DataBits != 0)
+        {
+            VCP_Open(&vcp->CdcIf, &vcp->CdcIf.LineCoding);
+        }
+    }
+}
+
+/**
+ * @brief  Finishes the self-test when its time is up.
+ * @param  arg: VCP handle
+ */
+static void VCP_TestFinished(void * arg)
+{
+    VCP_StopTest(arg);
+}
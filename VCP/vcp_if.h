@@ -30,31 +30,110 @@ extern "C"
 
 #include <usbd_cdc.h>
 #include <xpd_usart.h>
+#include <scheduler.h>
 
-#define VCP_OUT_DATA_SIZE   128
-#define VCP_IN_DATA_SIZE    128
+/* Max packet size of the USB bulk endpoints */
+#define VCP_PACKET_SIZE         64
 
+/* The OUT segments are sized to the USB bulk endpoint max packet size */
+#define VCP_OUT_SEGMENT_SIZE    VCP_PACKET_SIZE
+#ifndef VCP_OUT_SEGMENT_COUNT
+#define VCP_OUT_SEGMENT_COUNT   4
+#endif
+#define VCP_IN_DATA_SIZE        128
+
+/* Maximal accepted deviation of the achieved baudrate in per mille */
+#ifndef VCP_BAUDRATE_TOLERANCE
+#define VCP_BAUDRATE_TOLERANCE  20
+#endif
+
+/** @brief Counters of the lost received data */
+typedef struct {
+    uint32_t Dropped;       /* Received bytes overwritten before USB transmission */
+    uint16_t Overrun;       /* UART overrun errors */
+    uint16_t Framing;       /* UART framing errors */
+    uint16_t Parity;        /* UART parity errors */
+}VCP_RxErrorsType;
+
+/** @brief Bridge throughput statistics */
+typedef struct {
+    uint32_t OutBytes;      /* Bytes received over the USB OUT endpoint */
+    uint32_t OutTransfers;  /* Received USB OUT transfers */
+    uint32_t OutFull_us;    /* Time spent with all OUT segments occupied */
+    uint32_t InBytes;       /* Bytes transmitted over the USB IN endpoint */
+    uint32_t InTransfers;   /* Started USB IN transfers */
+    uint32_t InBusy;        /* USB IN transfer attempts rejected as busy */
+    uint32_t InMaxLevel;    /* Maximal level of unsent data in the IN buffer */
+    uint32_t LineChanges;   /* Line coding changes without reinitialization */
+    uint32_t LineSwitch_us; /* Duration of the last line coding change, including Tx drain */
+}VCP_StatsType;
+
+/** @brief Self-test modes */
 typedef enum
 {
-    VCP_BUFFER_EMPTY = 0,
-    VCP_BUFFER_FULL,
-    VCP_BUFFER_RECEIVING,
-    VCP_BUFFER_TRANSMITTING
-}VCP_BufferStatusType;
+    VCP_TEST_OFF = 0,       /* Normal USB-UART bridge operation */
+    VCP_TEST_PRBS,          /* PRBS stream through an external TX-RX jumper */
+    VCP_TEST_PRBS_INTERNAL, /* PRBS stream through the internal half-duplex loopback */
+    VCP_TEST_ECHO,          /* Bridge latency measurement, with TX-RX jumper */
+}VCP_TestModeType;
+
+/** @brief Self-test state and results */
+typedef struct {
+    VCP_TestModeType Mode;
+    uint32_t Duration_ms;   /* Requested length of the test */
+    uint32_t Time_ms;       /* Elapsed time of the finished test */
+    uint32_t Start_us;      /* Start time of the test */
+    Sched_TimerType Timer;  /* Finishes the test */
+    uint32_t Bytes;         /* Bytes received (PRBS) or echo transfers (ECHO) */
+    uint32_t BitErrors;     /* Bit errors in synchronized PRBS stream */
+    uint32_t SyncLosses;    /* Resynchronizations of the PRBS checker */
+    uint32_t LatencyMin_us;
+    uint32_t LatencyMax_us;
+    uint32_t LatencySum_us;
+    uint32_t EchoStart_us;  /* Arrival time of the OUT data under measurement */
+    uint16_t TxState;       /* PRBS generator state */
+    uint16_t RxState;       /* PRBS checker state */
+    uint8_t RxSync;         /* Number of bytes to load into the checker state */
+    uint8_t EchoPending;
+}VCP_TestType;
 
 typedef struct {
     USBD_CDC_IfHandleType CdcIf;
     USART_HandleType Uart;
-    uint8_t OutData[2][VCP_OUT_DATA_SIZE / 2];
-    VCP_BufferStatusType OutStatus[2];
-    uint16_t OutLength;
+    uint8_t OutData[VCP_OUT_SEGMENT_COUNT][VCP_OUT_SEGMENT_SIZE];
+    uint8_t OutDiscard[VCP_OUT_SEGMENT_SIZE]; /* Receives the OUT data during the PRBS test */
+    uint16_t OutLength[VCP_OUT_SEGMENT_COUNT];
+    uint8_t OutHead;        /* The segment receiving the USB OUT endpoint data */
+    uint8_t OutTail;        /* The oldest segment waiting for UART transmission */
+    uint8_t OutCount;       /* The number of received segments */
+    uint8_t OutTxCount;     /* The number of segments under UART transmission */
     uint8_t InData[VCP_IN_DATA_SIZE];
+    uint8_t InGather[VCP_PACKET_SIZE]; /* Packet assembled at the circular buffer's wrap */
+    uint16_t InLength;      /* The length of the ongoing USB IN transfer */
     uint16_t Index;
+    volatile uint8_t InWraps; /* Buffer wraps of the UART DMA, written by the producer only */
+    uint8_t InWrapsRead;    /* Buffer wraps consumed by Index, written by the consumer only */
+    uint8_t OutDrain;       /* The number of segments to transmit before the line change */
+    uint8_t LineChange;     /* Set while a line coding change is pending */
+    uint32_t LineChangeStart_us;
+    uint32_t OutFullStart_us;
+    Sched_TimerType RetryTimer; /* Retries the rejected USB IN transfers */
+    uint8_t MatchEnable;    /* Set when the received data is flushed on MatchChar */
+    uint8_t MatchChar;      /* The delimiter of line oriented traffic */
+    VCP_RxErrorsType RxErrors;
+    VCP_StatsType Stats;
+    VCP_TestType Test;
+    volatile USBD_CDC_SerialStateType SerialState; /* Pending serial state notification */
 }VCP_HandleType;
 
 extern const USBD_CDC_AppType vcpApp;
 
-void VCP_Periodic(VCP_HandleType *vcp);
+void VCP_IRQHandler(VCP_HandleType *vcp);
+void VCP_ResetStats(VCP_HandleType *vcp);
+void VCP_SetCharMatch(VCP_HandleType *vcp, uint8_t Enable, uint8_t Character);
+void VCP_StartTest(VCP_HandleType *vcp, VCP_TestModeType Mode,
+        uint32_t Baudrate, uint32_t Duration_ms);
+void VCP_StopTest(VCP_HandleType *vcp);
 
 #ifdef __cplusplus
 }
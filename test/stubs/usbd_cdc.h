@@ -0,0 +1,38 @@
+/* Host test stand-in of the USBDevice CDC class */
+#ifndef __USBD_CDC_H_
+#define __USBD_CDC_H_
+
+#include <usbd_types.h>
+
+typedef struct {
+    uint32_t DTERate;
+    uint8_t CharFormat;
+    uint8_t ParityType;
+    uint8_t DataBits;
+}USBD_CDC_LineCodingType;
+
+typedef union {
+    struct { uint16_t RxCarrier:1, TxCarrier:1, Break:1, RingSignal:1,
+                      Framing:1, Parity:1, OverRun:1; } b;
+    uint16_t w;
+}USBD_CDC_SerialStateType;
+
+typedef struct {
+    const char* Name;
+    void (*Open)(void* itf, USBD_CDC_LineCodingType * line);
+    void (*Close)(void* itf);
+    void (*Received)(void* itf, uint8_t * pbuf, uint16_t length);
+    void (*Transmitted)(void* itf, uint8_t * pbuf, uint16_t length);
+}USBD_CDC_AppType;
+
+typedef struct {
+    USBD_IfHandleType Base;
+    const USBD_CDC_AppType *App;
+    USBD_CDC_LineCodingType LineCoding;
+}USBD_CDC_IfHandleType;
+
+USBD_ReturnType USBD_CDC_Transmit(USBD_CDC_IfHandleType * itf, uint8_t * data, uint16_t length);
+USBD_ReturnType USBD_CDC_Receive(USBD_CDC_IfHandleType * itf, uint8_t * data, uint16_t length);
+USBD_ReturnType USBD_CDC_NotifySerialState(USBD_CDC_IfHandleType * itf, USBD_CDC_SerialStateType state);
+
+#endif /* __USBD_CDC_H_ */
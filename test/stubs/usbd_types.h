@@ -0,0 +1,16 @@
+/* Host test stand-in of the USBDevice types */
+#ifndef __USBD_TYPES_H_
+#define __USBD_TYPES_H_
+
+#include <xpd_common.h>
+
+typedef enum { USBD_E_OK = 0, USBD_E_BUSY, USBD_E_ERROR } USBD_ReturnType;
+
+typedef struct { uint8_t ConfigSelector; } USBD_HandleType;
+
+typedef struct {
+    USBD_HandleType *Device;
+    uint8_t AltCount;
+}USBD_IfHandleType;
+
+#endif /* __USBD_TYPES_H_ */
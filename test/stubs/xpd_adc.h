@@ -0,0 +1,56 @@
+/* Host test stand-in of the XPD ADC driver, the registers are plain memory */
+#ifndef __XPD_ADC_H_
+#define __XPD_ADC_H_
+
+#include <xpd_dma.h>
+#include <xpd_tim.h>
+
+typedef struct {
+    union { struct { uint32_t :23, AWDSGL:1, AWDEN:1, :1, AWDCH:5; } b; uint32_t w; } CFGR1;
+    union { struct { uint32_t LT:12, :4, HT:12; } b; uint32_t w; } TR;
+    union { struct { uint32_t :7, AWDIE:1; } b; uint32_t w; } IER;
+    union { struct { uint32_t :7, AWD:1; } b; uint32_t w; } ISR;
+}ADC_TypeDef;
+
+typedef struct {
+    ADC_TypeDef *Inst;
+    struct {
+        void (*ConvComplete)(void *handle);
+        void (*Watchdog)(void *handle);
+    }Callbacks;
+    TIM_HandleType *Trigger;
+}ADC_HandleType;
+
+typedef struct {
+    int ContinuousDMARequests, ContinuousMode, DiscontinuousCount, EndFlagSelection,
+        LeftAlignment, Resolution, ScanDirection, TriggerSource, TriggerEdge,
+        LPAutoWait, LPAutoPowerOff;
+}ADC_InitType;
+
+typedef struct {
+    uint8_t Number;
+    uint8_t SampleTime;
+}ADC_ChannelInitType;
+
+enum { ADC_EOC_SEQUENCE, ADC_RESOLUTION_12BIT, ADC_SCAN_FORWARD,
+       ADC_TRIGGER_TIM3_TRGO, EDGE_RISING };
+enum { ADC_SAMPLETIME_1p5, ADC_SAMPLETIME_7p5, ADC_SAMPLETIME_13p5, ADC_SAMPLETIME_28p5,
+       ADC_SAMPLETIME_41p5, ADC_SAMPLETIME_55p5, ADC_SAMPLETIME_71p5, ADC_SAMPLETIME_239p5 };
+
+#define ADC1_TEMPSENSOR_CHANNEL         16
+#define ADC1_VREFINT_CHANNEL            17
+
+void ADC_vInit(ADC_HandleType * hadc, const ADC_InitType * Config);
+void ADC_vDeinit(ADC_HandleType * hadc);
+XPD_ReturnType ADC_eCalibrate(ADC_HandleType * hadc, bool SingleDiff);
+void ADC_vChannelConfig(ADC_HandleType * hadc, const ADC_ChannelInitType * Channels, uint8_t Count);
+XPD_ReturnType ADC_eStart_DMA(ADC_HandleType * hadc, void * Address);
+void ADC_vStop_DMA(ADC_HandleType * hadc);
+
+#define ADC_REG_BIT(HANDLE, REG, BIT)   ((HANDLE)->Inst->REG.b.BIT)
+#define ADC_IT_ENABLE(HANDLE, IT)       ((HANDLE)->Inst->IER.b.IT##IE = 1)
+#define ADC_IT_DISABLE(HANDLE, IT)      ((HANDLE)->Inst->IER.b.IT##IE = 0)
+#define ADC_FLAG_STATUS(HANDLE, FLAG)   ((HANDLE)->Inst->ISR.b.FLAG)
+#define ADC_FLAG_CLEAR(HANDLE, FLAG)    ((HANDLE)->Inst->ISR.b.FLAG = 0)
+
+#endif /* __XPD_ADC_H_ */
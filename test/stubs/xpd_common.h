@@ -0,0 +1,40 @@
+/* Host test stand-in of the XPD common definitions and the CMSIS core */
+#ifndef __XPD_COMMON_H_
+#define __XPD_COMMON_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define __packed                __attribute__((packed))
+#define __align(X)              __attribute__((aligned(X)))
+#define __COMPILER_BARRIER()    __asm volatile ("" ::: "memory")
+#define __DMB()                 __sync_synchronize()
+
+#define container_of(PTR, TYPE, MEMBER) \
+    ((TYPE*)((char*)(PTR) - offsetof(TYPE, MEMBER)))
+
+#define ENABLE                  1
+#define DISABLE                 0
+typedef int FunctionalState;
+
+typedef enum { XPD_OK = 0, XPD_ERROR, XPD_BUSY, XPD_TIMEOUT } XPD_ReturnType;
+
+typedef enum
+{
+    PendSV_IRQn = -2, SysTick_IRQn = -1,
+    EXTI0_1_IRQn = 5, EXTI4_15_IRQn = 7, ADC1_IRQn = 12,
+    DMA1_Channel1_IRQn = 9, DMA1_Channel4_5_IRQn = 11,
+    TIM2_IRQn = 15, USART2_IRQn = 28, USB_IRQn = 31,
+}IRQn_Type;
+
+void NVIC_EnableIRQ(IRQn_Type IRQn);
+void NVIC_DisableIRQ(IRQn_Type IRQn);
+void NVIC_SetPendingIRQ(IRQn_Type IRQn);
+
+uint32_t __get_PRIMASK(void);
+void __set_PRIMASK(uint32_t primask);
+void __disable_irq(void);
+void __enable_irq(void);
+
+#endif /* __XPD_COMMON_H_ */
@@ -0,0 +1,30 @@
+/* Host test stand-in of the XPD DMA driver, the channel is plain memory */
+#ifndef __XPD_DMA_H_
+#define __XPD_DMA_H_
+
+#include <xpd_common.h>
+
+typedef struct {
+    volatile uint32_t CNDTR;    /* Remaining transfers */
+    volatile uint32_t TC;       /* Transfer complete flag */
+}DMA_Channel_TypeDef;
+
+typedef struct {
+    DMA_Channel_TypeDef *Inst;
+    void *Owner;
+    struct {
+        void (*Complete)(void *handle);
+        void (*HalfComplete)(void *handle);
+        void (*Error)(void *handle);
+    }Callbacks;
+}DMA_HandleType;
+
+uint16_t DMA_usGetStatus(DMA_HandleType *hdma);
+void DMA_vStop(DMA_HandleType *hdma);
+
+#define DMA_IT_ENABLE(HANDLE, IT)       ((void)(HANDLE))
+#define DMA_IT_DISABLE(HANDLE, IT)      ((void)(HANDLE))
+#define DMA_FLAG_STATUS(HANDLE, FLAG)   ((HANDLE)->Inst->FLAG)
+#define DMA_FLAG_CLEAR(HANDLE, FLAG)    ((HANDLE)->Inst->FLAG = 0)
+
+#endif /* __XPD_DMA_H_ */
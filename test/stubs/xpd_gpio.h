@@ -0,0 +1,19 @@
+/* Host test stand-in of the XPD GPIO driver */
+#ifndef __XPD_GPIO_H_
+#define __XPD_GPIO_H_
+
+#include <xpd_common.h>
+
+typedef struct {
+    int Mode, Pull, AlternateMap;
+    struct { int Type, Speed; } Output;
+    struct { int Edge, Reaction; } ExtI;
+}GPIO_InitType;
+
+enum { PA0, PA1, PA2, PA3, PA4, PA5, PA6, PA7, PA11, PA12, PB1, PB8, PF0, PF1, GPIO_PIN_COUNT };
+
+void GPIO_vInitPin(int Pin, const GPIO_InitType * Config);
+void GPIO_vWritePin(int Pin, int Value);
+int GPIO_eReadPin(int Pin);
+
+#endif /* __XPD_GPIO_H_ */
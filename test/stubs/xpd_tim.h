@@ -0,0 +1,35 @@
+/* Host test stand-in of the XPD TIM driver, the registers are plain memory */
+#ifndef __XPD_TIM_H_
+#define __XPD_TIM_H_
+
+#include <xpd_common.h>
+
+typedef struct {
+    union { uint32_t w; } CNT, ARR, CCR1;
+}TIM_TypeDef;
+
+typedef struct {
+    TIM_TypeDef *Inst;
+}TIM_HandleType;
+
+typedef struct {
+    int Mode;
+    uint32_t Prescaler;
+    uint32_t Period;
+}TIM_InitType;
+
+typedef struct {
+    int MasterSlaveMode;
+    int MasterTrigger;
+}TIM_MasterConfigType;
+
+enum { TIM_COUNTER_UP, TIM_TRGO_UPDATE };
+
+uint32_t TIM_ulClockFreq_Hz(TIM_HandleType * htim);
+void TIM_vCounterInit(TIM_HandleType * htim, const TIM_InitType * Config);
+void TIM_vMasterConfig(TIM_HandleType * htim, const TIM_MasterConfigType * Config);
+void TIM_vCounterStart(TIM_HandleType * htim);
+void TIM_vCounterStop(TIM_HandleType * htim);
+void TIM_vDeinit(TIM_HandleType * htim);
+
+#endif /* __XPD_TIM_H_ */
@@ -0,0 +1,64 @@
+/* Host test stand-in of the XPD USART driver, the registers are plain memory */
+#ifndef __XPD_USART_H_
+#define __XPD_USART_H_
+
+#include <xpd_dma.h>
+
+typedef struct {
+    union { struct { uint32_t UE:1, UESM:1, RE:1, TE:1, IDLEIE:1, RXNEIE:1, TCIE:1, TXEIE:1,
+                              PEIE:1, PS:1, PCE:1, WAKE:1, M0:1, MME:1, CMIE:1, OVER8:1,
+                              DEDT:5, DEAT:5, RTOIE:1, EOBIE:1, M1:1; } b; uint32_t w; } CR1;
+    union { struct { uint32_t :4, ADDM7:1, :7, STOP:2, :10, ADD:8; } b; uint32_t w; } CR2;
+    union { struct { uint32_t EIE:1, :5, DMAR:1, DMAT:1, RTSE:1, CTSE:1, CTSIE:1; } b; uint32_t w; } CR3;
+    union { uint32_t w; } BRR;
+    union { struct { uint32_t PE:1, FE:1, NF:1, ORE:1, IDLE:1, RXNE:1, TC:1, TXE:1,
+                              :1, CTSIF:1, CTS:1, :6, CMF:1; } b; uint32_t w; } ISR;
+    union { struct { uint32_t PE:1, FE:1, NF:1, ORE:1, IDLE:1, RXNE:1, TC:1, :10, CM:1; } b; uint32_t w; } ICR;
+}USART_TypeDef;
+
+typedef struct {
+    USART_TypeDef *Inst;
+    struct {
+        void (*Transmit)(void *handle);
+        void (*Receive)(void *handle);
+        void (*Error)(void *handle);
+    }Callbacks;
+    struct {
+        DMA_HandleType *Transmit;
+        DMA_HandleType *Receive;
+    }DMA;
+}USART_HandleType;
+
+typedef struct {
+    uint32_t Baudrate;
+    int Directions;
+    uint8_t DataSize;
+    int StopBits;
+    FunctionalState SingleSample;
+    int Parity;
+    int FlowControl;
+    FunctionalState OverSampling8;
+    FunctionalState HalfDuplex;
+}UART_InitType;
+
+enum { USART_DIR_TX_RX, USART_STOPBITS_1, USART_STOPBITS_2,
+       USART_PARITY_NONE, USART_PARITY_ODD, USART_PARITY_EVEN,
+       UART_FLOWCONTROL_NONE, UART_FLOWCONTROL_CTS };
+
+void USART_vInitAsync(USART_HandleType * husart, const UART_InitType * Config);
+void USART_vDeinit(USART_HandleType * husart);
+XPD_ReturnType USART_eTransmit_DMA(USART_HandleType * husart, void * Data, uint16_t Length);
+XPD_ReturnType USART_eReceive_DMA(USART_HandleType * husart, void * Data, uint16_t Length);
+void USART_vIRQHandler(USART_HandleType * husart);
+uint32_t USART_ulClockFreq_Hz(USART_HandleType * husart);
+
+#define USART_REG_BIT(HANDLE, REG, BIT) ((HANDLE)->Inst->REG.b.BIT)
+#define USART_FLAG_STATUS(HANDLE, FLAG) ((HANDLE)->Inst->ISR.b.FLAG)
+#define USART_FLAG_CLEAR(HANDLE, FLAG)  ((HANDLE)->Inst->ICR.b.FLAG = 1, \
+        (HANDLE)->Inst->ISR.w &= ~(HANDLE)->Inst->ICR.w, (HANDLE)->Inst->ICR.w = 0)
+#define USART_IT_ENABLE(HANDLE, IT)     ((HANDLE)->Inst->CR1.b.IT##IE = 1)
+#define USART_IT_DISABLE(HANDLE, IT)    ((HANDLE)->Inst->CR1.b.IT##IE = 0)
+#define USART_ENABLE(HANDLE)            ((HANDLE)->Inst->CR1.b.UE = 1)
+#define USART_DISABLE(HANDLE)           ((HANDLE)->Inst->CR1.b.UE = 0)
+
+#endif /* __XPD_USART_H_ */
@@ -0,0 +1,53 @@
+/**
+  ******************************************************************************
+  * @file    test.h
+  * @author  Benedek Kupper
+  * @version 1.0
+  * @date    2026-10-16
+  * @brief   Minimal host test harness
+  *
+  * Copyright (c) 2026 Benedek Kupper
+  *
+  * Licensed under the Apache License, Version 2.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  *     http://www.apache.org/licenses/LICENSE-2.0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  */
+#ifndef __TEST_H_
+#define __TEST_H_
+
+#include <stdio.h>
+
+static int testFailures;
+
+/* Records a failed check, the test case continues */
+#define TEST_CHECK(COND)                                                    \
+    do { if (!(COND)) {                                                     \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #COND);     \
+        testFailures++; } } while (0)
+
+/* Records a failed comparison of two integers */
+#define TEST_EQUAL(EXPECTED, ACTUAL)                                        \
+    do { long long e_ = (long long)(EXPECTED), a_ = (long long)(ACTUAL);    \
+        if (e_ != a_) {                                                     \
+        printf("%s:%d: %s: expected %lld, got %lld\n",                      \
+               __FILE__, __LINE__, #ACTUAL, e_, a_);                        \
+        testFailures++; } } while (0)
+
+/* Runs a test case */
+#define TEST_RUN(CASE)                                                      \
+    do { int f_ = testFailures; CASE();                                     \
+        printf("%-40s %s\n", #CASE, (f_ == testFailures) ? "ok" : "FAILED"); \
+    } while (0)
+
+/* The exit code of the test executable */
+#define TEST_RESULT()           ((testFailures == 0) ? 0 : 1)
+
+#endif /* __TEST_H_ */
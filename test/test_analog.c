@@ -0,0 +1,477 @@
+/**
+  ******************************************************************************
+  * @file    test_analog.c
+  * @author  Benedek Kupper
+  * @version 1.0
+  * @date    2026-10-16
+  * @brief   Host tests of the analog measurements
+  *
+  *  @verbatim
+  *  The analog module is compiled with a faked ADC, its conversion
+  *  sequences are fed directly to the end of sequence callback.
+  *  The factory calibration words are mapped to their device address.
+  *  @endverbatim
+  *
+  * Copyright (c) 2026 Benedek Kupper
+  *
+  * Licensed under the Apache License, Version 2.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  *     http://www.apache.org/licenses/LICENSE-2.0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  */
+#include <test.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include "../Sensor/analog.c"
+
+/* The system memory page of the factory calibration */
+#define CAL_PAGE                0x1FFFF000
+
+/* Typical calibration of the device */
+#define VREFINT_CAL             1527
+#define TS_CAL1                 1755
+#define TS_CAL2                 1327
+
+static ADC_TypeDef adcRegs;
+static TIM_TypeDef trigRegs;
+static TIM_HandleType trigger = { .Inst = &trigRegs };
+static ADC_HandleType adcHandle = { .Inst = &adcRegs, .Trigger = &trigger };
+ADC_HandleType *const adc = &adcHandle;
+
+static bool triggerRunning;
+static Sched_WorkType *submitted;
+static uint32_t submissions;
+static Sched_WorkType measuredNotify;
+
+void Sched_WorkSubmit(Sched_WorkType * Work)
+{
+    submitted = Work;
+    submissions++;
+}
+
+void ADC_vInit(ADC_HandleType * hadc, const ADC_InitType * Config)
+{
+}
+
+void ADC_vDeinit(ADC_HandleType * hadc)
+{
+}
+
+XPD_ReturnType ADC_eCalibrate(ADC_HandleType * hadc, bool SingleDiff)
+{
+    return XPD_OK;
+}
+
+void ADC_vChannelConfig(ADC_HandleType * hadc, const ADC_ChannelInitType * Channels, uint8_t Count)
+{
+}
+
+XPD_ReturnType ADC_eStart_DMA(ADC_HandleType * hadc, void * Address)
+{
+    return XPD_OK;
+}
+
+void ADC_vStop_DMA(ADC_HandleType * hadc)
+{
+}
+
+uint32_t TIM_ulClockFreq_Hz(TIM_HandleType * htim)
+{
+    return 48000000;
+}
+
+void TIM_vCounterInit(TIM_HandleType * htim, const TIM_InitType * Config)
+{
+}
+
+void TIM_vMasterConfig(TIM_HandleType * htim, const TIM_MasterConfigType * Config)
+{
+}
+
+void TIM_vCounterStart(TIM_HandleType * htim)
+{
+    triggerRunning = true;
+}
+
+void TIM_vCounterStop(TIM_HandleType * htim)
+{
+    triggerRunning = false;
+}
+
+void TIM_vDeinit(TIM_HandleType * htim)
+{
+    triggerRunning = false;
+}
+
+void GPIO_vInitPin(int Pin, const GPIO_InitType * Config)
+{
+}
+
+const GPIO_InitType BSP_IOCfg[8];
+
+/* Maps the factory calibration words to their device address */
+static bool mapCalibration(void)
+{
+    void *page = mmap((void*)CAL_PAGE, 0x1000, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+
+    if (page != (void*)CAL_PAGE)
+    {
+        printf("calibration page cannot be mapped\n");
+        return false;
+    }
+    *(uint16_t *)0x1FFFF7B8 = TS_CAL1;
+    *(uint16_t *)0x1FFFF7BA = VREFINT_CAL;
+    *(uint16_t *)0x1FFFF7C2 = TS_CAL2;
+    return true;
+}
+
+/* Initializes the module with all channels scanned */
+static void analogSetup(void)
+{
+    Analog_Init();
+    Analog_SetNotification(&measuredNotify);
+    Analog_SetChannels(ANALOG_USER_SENSOR, (1 << ADCH_COUNT) - 1);
+    if (submitted == &analogRescanWork)
+    {
+        submitted->Callback(submitted->Arg);
+    }
+    submitted = NULL;
+    measurementSeq = 0;
+    submissions = 0;
+}
+
+/* Completes a conversion sequence with the given channel values */
+static void analogSequence(const uint16_t values[ADCH_COUNT])
+{
+    uint8_t i;
+
+    for (i = 0; i < adcScanCount; i++)
+    {
+        conversions[i] = values[adcScan[i]];
+    }
+    adc->Callbacks.ConvComplete(adc);
+}
+
+/**
+ * @brief Each measurement is the boxcar average of the oversampled
+ *        sequences, keeping the extra resolution of the dithered inputs.
+ */
+static void oversamplingDecimation(void)
+{
+    static const struct {
+        uint16_t base;
+        uint8_t increments; /* sequences with base + 1 */
+        uint16_t sample;
+    }table[] = {
+        {    0,  0,     0 },
+        { 1000,  0,  4000 },
+        { 1000,  1,  4000 }, /* below the extra resolution */
+        { 1000,  4,  4001 },
+        { 1000,  8,  4002 },
+        { 1000, 12,  4003 },
+        { 1000, 15,  4003 },
+        { 4094,  8, 16378 },
+        { 4095,  0, ANALOG_FULL_SCALE },
+    };
+    uint8_t i, seq, ch;
+
+    TEST_EQUAL(16, ANALOG_OVERSAMPLING);
+    TEST_EQUAL(2, ANALOG_EXTRA_BITS);
+
+    analogSetup();
+
+    for (i = 0; i < sizeof(table) / sizeof(table[0]); i++)
+    {
+        uint32_t published = measurementSeq;
+
+        for (seq = 0; seq < ANALOG_OVERSAMPLING; seq++)
+        {
+            uint16_t values[ADCH_COUNT];
+
+            for (ch = 0; ch < ADCH_COUNT; ch++)
+            {
+                values[ch] = table[i].base + ((seq < table[i].increments) ? 1 : 0);
+            }
+            TEST_EQUAL(published, measurementSeq);
+            analogSequence(values);
+        }
+
+        /* A measurement is published after the last sequence */
+        TEST_EQUAL(published + 1, measurementSeq);
+        for (ch = 0; ch < ADCH_COUNT; ch++)
+        {
+            TEST_EQUAL(table[i].sample, samples[ch]);
+        }
+    }
+    TEST_EQUAL(sizeof(table) / sizeof(table[0]), submissions);
+
+    /* The channels out of the scan are measured as 0 */
+    Analog_SetChannels(ANALOG_USER_SENSOR, ADCH_MASK(ADCH_VBAT));
+    submitted->Callback(submitted->Arg);
+    submitted = NULL;
+    for (seq = 0; seq < ANALOG_OVERSAMPLING; seq++)
+    {
+        static const uint16_t values[ADCH_COUNT] = {
+            [ADCH_VBAT] = 2000, [ADCH_LIGHT_SENSOR] = 2000, [ADCH_VREFINT] = VREFINT_CAL };
+        analogSequence(values);
+    }
+    TEST_EQUAL(8000, samples[ADCH_VBAT]);
+    TEST_EQUAL(0, samples[ADCH_LIGHT_SENSOR]);
+    TEST_EQUAL(VREFINT_CAL << ANALOG_EXTRA_BITS, samples[ADCH_VREFINT]);
+}
+
+/**
+ * @brief The fixed-point conversion of each channel stays within 1.5 output
+ *        units of the exact value (1 of the truncated result, the rest of
+ *        the coefficient rounding) over the whole input and supply range.
+ *        The supply voltage and the temperature are checked as well.
+ */
+static void fixedPointScaling(void)
+{
+    static const struct {
+        ADCHType ch;
+        uint32_t num, den;
+    }table[] = {
+#if (HW_REV > 0xA)
+        { ADCH_IOUT,            1,   1 },
+#endif
+        { ADCH_LIGHT_SENSOR,    5,  30 },
+        { ADCH_VBAT,          600, 470 },
+        { ADCH_ICHARGE,        54, 102 },
+    };
+    static const uint32_t vdda[] = { 2000, 2400, 3000, 3300, 3600 };
+    uint8_t i, v;
+    uint32_t s;
+
+    analogSetup();
+
+    for (i = 0; i < sizeof(table) / sizeof(table[0]); i++)
+    {
+        double maxError = 0;
+
+        for (v = 0; v < sizeof(vdda) / sizeof(vdda[0]); v++)
+        {
+            for (s = 0; s <= ANALOG_FULL_SCALE; s++)
+            {
+                double exact = (double)s * vdda[v] * table[i].num
+                             / ((double)table[i].den * ANALOG_FULL_SCALE);
+                double error;
+
+                samples[table[i].ch] = s;
+                error = analogScale(table[i].ch, vdda[v]) - exact;
+                if (error < 0)
+                {
+                    error = -error;
+                }
+                if (error > maxError)
+                {
+                    maxError = error;
+                }
+            }
+        }
+        printf("  channel %u: max error %.3f\n", table[i].ch, maxError);
+        TEST_CHECK(maxError < 1.5);
+    }
+
+    /* VDDA from the internal reference, temperature from the sensor */
+    for (v = 0; v < sizeof(vdda) / sizeof(vdda[0]); v++)
+    {
+        static const int32_t temps[] = { -20, 0, 30, 60, 110 };
+        uint16_t values[ADCH_COUNT] = { 0 };
+        AnalogMeasurementsType meas;
+        uint8_t t, seq;
+
+        for (t = 0; t < sizeof(temps) / sizeof(temps[0]); t++)
+        {
+            /* The sensor voltage at the temperature, converted at VDDA */
+            double ts = TS_CAL1 + (double)(TS_CAL2 - TS_CAL1) * (temps[t] - ANALOG_TS_CAL1_C)
+                      / (ANALOG_TS_CAL2_C - ANALOG_TS_CAL1_C);
+
+            values[ADCH_VREFINT] = (VREFINT_CAL * ANALOG_CAL_VDDA_mV + vdda[v] / 2) / vdda[v];
+            values[ADCH_TEMP] = (uint16_t)(ts * ANALOG_CAL_VDDA_mV / vdda[v] + 0.5);
+            for (seq = 0; seq < ANALOG_OVERSAMPLING; seq++)
+            {
+                analogSequence(values);
+            }
+            Analog_GetValues(&meas);
+
+            TEST_CHECK(abs(meas.Vdd_mV - (int32_t)vdda[v]) <= 2);
+            TEST_CHECK(abs(meas.temp_C - temps[t]) <= 1);
+        }
+    }
+}
+
+/**
+ * @brief The totals integrate each measurement frame without losing
+ *        the energy below the reported resolution.
+ */
+static void meterIntegration(void)
+{
+    uint16_t values[ADCH_COUNT] = { 0 };
+    uint64_t charge_nC = 0, energy_pJ = 0;
+    AnalogMeasurementsType meas;
+    AnalogTotalsType sum;
+    uint32_t frame, seq;
+
+    analogSetup();
+    Analog_ResetTotals();
+
+    values[ADCH_VREFINT] = VREFINT_CAL;
+    values[ADCH_VBAT] = 2900;
+    values[ADCH_ICHARGE] = 1500;
+    for (frame = 0; frame < 1000; frame++)
+    {
+        /* The first frame only restarts the integration */
+        for (seq = 0; seq < ANALOG_OVERSAMPLING; seq++)
+        {
+            analogSequence(values);
+        }
+        Analog_GetValues(&meas);
+        if (frame > 0)
+        {
+            charge_nC += (uint64_t)meas.Ichrg_mA * analogFrame_us;
+            energy_pJ += (uint64_t)meas.Ichrg_mA * meas.Vbat_mV * analogFrame_us;
+        }
+    }
+    Analog_GetTotals(&sum);
+
+    TEST_CHECK(meas.Ichrg_mA > 0);
+    TEST_EQUAL(999ULL * analogFrame_us, sum.Time_us);
+    TEST_EQUAL(charge_nC, sum.Qchrg_nC);
+    TEST_EQUAL(energy_pJ, sum.Echrg_pJ);
+}
+
+#if (HW_REV > 0xA)
+/**
+ * @brief The output current watchdog is only reconfigured when the limit
+ *        changes, and a disarmed watchdog is armed again when the output
+ *        current is measured again.
+ */
+static void watchdogRearm(void)
+{
+    AnalogMeasurementsType meas;
+
+    analogSetup();
+    Analog_GetValues(&meas);
+
+    Analog_SetIoutLimit(500, NULL);
+    TEST_CHECK(submitted == &analogRescanWork);
+    submitted->Callback(submitted->Arg);
+    submitted = NULL;
+    TEST_EQUAL(1, adcRegs.IER.b.AWDIE);
+    TEST_EQUAL(500 * 4095 / meas.Vdd_mV, adcRegs.TR.b.HT);
+
+    /* The same limit needs no rescan */
+    submissions = 0;
+    Analog_SetIoutLimit(500, NULL);
+    TEST_EQUAL(0, submissions);
+
+    /* Tripped while the output current remains in the scan */
+    Analog_SetOutputVoltage(5000);
+    Analog_IoutDisarm();
+    TEST_EQUAL(0, adcRegs.IER.b.AWDIE);
+    TEST_EQUAL(0, analogVout_mV);
+    Analog_IoutConfig(ENABLE);
+    TEST_EQUAL(1, submissions);
+    submitted->Callback(submitted->Arg);
+    submitted = NULL;
+    TEST_EQUAL(1, adcRegs.IER.b.AWDIE);
+
+    /* No rescan while the watchdog is armed */
+    Analog_IoutConfig(ENABLE);
+    TEST_EQUAL(1, submissions);
+}
+#endif
+
+/**
+ * @brief The sampling request only takes effect in the rescan,
+ *        the running scan is not modified by the caller.
+ */
+static void deferredSampling(void)
+{
+    uint32_t period = trigRegs.ARR.w;
+    uint16_t rate_Hz;
+    uint8_t sampleTime;
+
+    analogSetup();
+
+    TEST_CHECK(Analog_SetSampling(400, ADC_SAMPLETIME_71p5));
+    TEST_CHECK(submitted == &analogRescanWork);
+    Analog_GetSampling(&rate_Hz, &sampleTime);
+    TEST_EQUAL(400, rate_Hz);
+    TEST_EQUAL(ADC_SAMPLETIME_71p5, sampleTime);
+    TEST_EQUAL(ADC_SAMPLETIME_239p5, adcChannels[0].SampleTime);
+    TEST_EQUAL(period, trigRegs.ARR.w);
+    TEST_EQUAL(ANALOG_RATE_HZ * ANALOG_OVERSAMPLING, Analog_GetScanRate_Hz());
+
+    submitted->Callback(submitted->Arg);
+    submitted = NULL;
+    TEST_EQUAL(ADC_SAMPLETIME_71p5, adcChannels[ADCH_COUNT - 1].SampleTime);
+    TEST_EQUAL(analogTriggerPeriod(400) - 1, trigRegs.ARR.w);
+    TEST_EQUAL(400 * ANALOG_OVERSAMPLING, Analog_GetScanRate_Hz());
+
+    TEST_CHECK(Analog_SetSampling(ANALOG_RATE_HZ, ADC_SAMPLETIME_239p5));
+    submitted->Callback(submitted->Arg);
+    submitted = NULL;
+}
+
+/**
+ * @brief The conversions are triggered as long as any user requires
+ *        channels, a user leaving doesn't stop the others' measurements.
+ */
+static void triggerByUsers(void)
+{
+    analogSetup();
+    TEST_CHECK(triggerRunning);
+
+    Analog_SetChannels(ANALOG_USER_CHARGER, ADCH_MASK(ADCH_VBAT));
+    Analog_SetChannels(ANALOG_USER_SENSOR, 0);
+    TEST_CHECK(submitted == &analogRescanWork);
+    submitted->Callback(submitted->Arg);
+    submitted = NULL;
+    TEST_CHECK(triggerRunning);
+
+    Analog_SetChannels(ANALOG_USER_CHARGER, 0);
+#if (HW_REV > 0xA)
+    Analog_SetChannels(ANALOG_USER_OUTPUT, 0);
+#endif
+    submitted->Callback(submitted->Arg);
+    submitted = NULL;
+    TEST_CHECK(!triggerRunning);
+
+    /* A single channel restarts the conversions */
+    Analog_SetChannels(ANALOG_USER_SENSOR, ADCH_MASK(ADCH_VREFINT));
+    TEST_CHECK(submitted == &analogRescanWork);
+    submitted->Callback(submitted->Arg);
+    submitted = NULL;
+    TEST_CHECK(triggerRunning);
+#if (HW_REV > 0xA)
+    Analog_SetChannels(ANALOG_USER_OUTPUT, ADCH_MASK(ADCH_IOUT));
+    submitted = NULL;
+#endif
+}
+
+int main(void)
+{
+    if (!mapCalibration())
+    {
+        return 1;
+    }
+    TEST_RUN(oversamplingDecimation);
+    TEST_RUN(fixedPointScaling);
+    TEST_RUN(meterIntegration);
+#if (HW_REV > 0xA)
+    TEST_RUN(watchdogRearm);
+#endif
+    TEST_RUN(deferredSampling);
+    TEST_RUN(triggerByUsers);
+    return TEST_RESULT();
+}
@@ -0,0 +1,148 @@
+/**
+  ******************************************************************************
+  * @file    test_efuse.c
+  * @author  Benedek Kupper
+  * @version 1.0
+  * @date    2026-10-16
+  * @brief   Host tests of the output I2t protection
+  *
+  *  @verbatim
+  *  Constant and pulsed current profiles are replayed at the oversampled
+  *  scan rate, the trip times are compared to the analytic trip curve.
+  *  @endverbatim
+  *
+  * Copyright (c) 2026 Benedek Kupper
+  *
+  * Licensed under the Apache License, Version 2.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  *     http://www.apache.org/licenses/LICENSE-2.0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  */
+#include <test.h>
+#include <math.h>
+#include "../Charger/efuse.c"
+
+/* The default oversampled scan rate */
+#define SCAN_RATE_Hz            1600
+
+/* The longest replay */
+#define REPLAY_s                60
+
+static const Efuse_ConfigType curve = {
+    .Nominal_mA = 300,
+    .Tau_ms     = 1000,
+    .Inrush_ms  = 100,
+};
+
+/* Replays a constant current after switch-on,
+ * returns the number of samples until the trip */
+static uint32_t replayConstant(uint32_t Current_mA, uint32_t Rate_Hz)
+{
+    uint32_t n;
+
+    Efuse_Restart();
+    for (n = 0; n < (REPLAY_s * Rate_Hz); n++)
+    {
+        if (Efuse_Sample(Current_mA, Rate_Hz))
+        {
+            break;
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief The protection is disabled by default,
+ *        only the hard current limit is active.
+ */
+static void defaultDisabled(void)
+{
+    Efuse_ConfigType config;
+
+    Efuse_GetConfig(&config);
+    TEST_EQUAL(0, config.Nominal_mA);
+
+    TEST_EQUAL(REPLAY_s * SCAN_RATE_Hz, replayConstant(3000, SCAN_RATE_Hz));
+}
+
+/**
+ * @brief Overloads trip after Tau * ln(I^2 / (I^2 - In^2)),
+ *        but not before the end of the inrush allowance.
+ *        Currents up to the nominal never trip.
+ */
+static void tripCurve(void)
+{
+    static const uint32_t loads[] = { 310, 330, 450, 600, 900, 3000 };
+    static const uint32_t rates[] = { 400, SCAN_RATE_Hz, 6400 };
+    uint8_t i, r;
+
+    Efuse_SetConfig(&curve);
+
+    for (r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+    {
+        TEST_EQUAL(REPLAY_s * rates[r], replayConstant(curve.Nominal_mA, rates[r]));
+        TEST_EQUAL(REPLAY_s * rates[r], replayConstant(250, rates[r]));
+
+        for (i = 0; i < sizeof(loads) / sizeof(loads[0]); i++)
+        {
+            double ratio = (double)loads[i] * loads[i] / (curve.Nominal_mA * curve.Nominal_mA);
+            double expected_s = curve.Tau_ms * log(ratio / (ratio - 1)) / 1000;
+            double trip_s = (double)replayConstant(loads[i], rates[r]) / rates[r];
+
+            if (expected_s < (curve.Inrush_ms / 1000.0))
+            {
+                expected_s = curve.Inrush_ms / 1000.0;
+            }
+            /* The discrete model lags by up to a sample period, and the
+             * decay step is coarse at low rates */
+            TEST_CHECK(fabs(trip_s - expected_s) <= (expected_s * 0.03 + 1.0 / rates[r]));
+        }
+    }
+}
+
+/**
+ * @brief A short inrush pulse does not trip the nominal load,
+ *        while a heated model trips without inrush allowance.
+ */
+static void inrushPulse(void)
+{
+    uint32_t n;
+
+    Efuse_SetConfig(&curve);
+    Efuse_Restart();
+
+    /* 2 A for 20 ms, then the nominal load */
+    for (n = 0; n < (REPLAY_s * SCAN_RATE_Hz); n++)
+    {
+        if (Efuse_Sample((n < (SCAN_RATE_Hz / 50)) ? 2000 : 250, SCAN_RATE_Hz))
+        {
+            break;
+        }
+    }
+    TEST_EQUAL(REPLAY_s * SCAN_RATE_Hz, n);
+
+    /* The same pulse after the inrush time trips from the settled load */
+    for (n = 0; n < (SCAN_RATE_Hz / 50); n++)
+    {
+        if (Efuse_Sample(2000, SCAN_RATE_Hz))
+        {
+            break;
+        }
+    }
+    TEST_CHECK(n < (SCAN_RATE_Hz / 50));
+}
+
+int main(void)
+{
+    TEST_RUN(defaultDisabled);
+    TEST_RUN(tripCurve);
+    TEST_RUN(inrushPulse);
+    return TEST_RESULT();
+}
@@ -0,0 +1,252 @@
+/**
+  ******************************************************************************
+  * @file    test_gauge.c
+  * @author  Benedek Kupper
+  * @version 1.0
+  * @date    2026-10-16
+  * @brief   Host tests of the battery fuel gauge
+  *
+  *  @verbatim
+  *  A synthetic cell with the OCV curve of the gauge is charged and
+  *  relaxed, the gauge is updated each second with its voltage and the
+  *  integrated charge current. The cell voltage rises with the charge
+  *  current, and it is discharged without the gauge measuring it.
+  *  @endverbatim
+  *
+  * Copyright (c) 2026 Benedek Kupper
+  *
+  * Licensed under the Apache License, Version 2.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  *     http://www.apache.org/licenses/LICENSE-2.0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  */
+#include <test.h>
+#include <stdlib.h>
+#include "../Charger/gauge.c"
+
+/* Voltage rise under charge current */
+#define CELL_RESISTANCE_mOhm    200
+
+/* Charge current until the constant voltage phase */
+#define CELL_CHARGE_mA          300
+
+static struct {
+    double capacity_mAh;
+    double soc;                 /* 0 .. 1 */
+    uint64_t Qchrg_nC;
+    uint64_t Time_us;
+    bool charged;
+}cell;
+
+/* Starts the gauge and the cell from scratch */
+static void cellSetup(double Capacity_mAh, double Soc)
+{
+    Gauge_Restart();
+    gaugeFull_nC = 0;
+    gaugeCapacityChanged = false;
+    gaugeCharged = false;
+    gaugeLastQ_nC = 0;
+    gaugeLastTime_us = 0;
+
+    cell.capacity_mAh = Capacity_mAh;
+    cell.soc = Soc;
+    cell.Qchrg_nC = 0;
+    cell.Time_us = 0;
+    cell.charged = false;
+}
+
+/* The open circuit voltage of the cell */
+static uint32_t cellOcv_mV(void)
+{
+    uint8_t i;
+
+    for (i = 1; i < GAUGE_OCV_COUNT; i++)
+    {
+        if ((cell.soc * GAUGE_SOC_FULL) < gaugeOcv[i].soc)
+        {
+            return gaugeOcv[i - 1].mV + (cell.soc * GAUGE_SOC_FULL - gaugeOcv[i - 1].soc)
+                    * (gaugeOcv[i].mV - gaugeOcv[i - 1].mV) / (gaugeOcv[i].soc - gaugeOcv[i - 1].soc);
+        }
+    }
+    return gaugeOcv[GAUGE_OCV_COUNT - 1].mV;
+}
+
+/* Updates the gauge after a second with the charge current */
+static uint32_t cellStep(uint32_t Current_mA)
+{
+    Gauge_InputType input;
+
+    cell.soc += Current_mA / 3600.0 / cell.capacity_mAh;
+    cell.Qchrg_nC += Current_mA * 1000000ULL;
+    cell.Time_us += 1000000;
+    if (Current_mA > 0)
+    {
+        cell.charged = false;
+    }
+
+    input.Vbat_mV  = cellOcv_mV() + Current_mA * CELL_RESISTANCE_mOhm / 1000;
+    input.Ichrg_mA = Current_mA;
+    input.Qchrg_nC = cell.Qchrg_nC;
+    input.Time_us  = cell.Time_us;
+    input.Charged  = cell.charged;
+    return Gauge_Update(&input);
+}
+
+/* Relaxes the cell for the given time */
+static uint32_t cellRest(uint32_t Time_s)
+{
+    uint32_t remaining = 0;
+
+    while (Time_s-- > 0)
+    {
+        remaining = cellStep(0);
+    }
+    return remaining;
+}
+
+/* Charges the cell until the charge is complete,
+ * returns the largest error of the remaining capacity */
+static double cellCharge(void)
+{
+    double maxError = 0;
+
+    while (true)
+    {
+        /* Tapering current of the constant voltage phase */
+        double current = (cell.soc > 0.95) ? (CELL_CHARGE_mA * (1 - cell.soc) / 0.05) : CELL_CHARGE_mA;
+        double error;
+
+        if (current < (CELL_CHARGE_mA / 20))
+        {
+            break;
+        }
+        error = cellStep((uint32_t)current) - cell.soc * cell.capacity_mAh;
+        if (error < 0)
+        {
+            error = -error;
+        }
+        if (error > maxError)
+        {
+            maxError = error;
+        }
+    }
+    cell.charged = true;
+    cellStep(0);
+    return maxError;
+}
+
+/**
+ * @brief The gauge reports no charge until the battery is at rest,
+ *        a loaded or charging voltage is not used.
+ */
+static void restBeforeSync(void)
+{
+    uint32_t i;
+
+    cellSetup(500, 0.3);
+    Gauge_SetCapacity(500);
+
+    for (i = 0; i < 60; i++)
+    {
+        TEST_EQUAL(0, cellStep(CELL_CHARGE_mA));
+    }
+    TEST_EQUAL(0, cellRest(GAUGE_REST_TIME_s - 1));
+
+    /* Synchronized to the relaxed voltage */
+    TEST_CHECK(abs((int)cellRest(1) - (int)(cell.soc * cell.capacity_mAh)) <= 1);
+}
+
+/**
+ * @brief The end of charge synchronizes without rest.
+ */
+static void fullPointSync(void)
+{
+    cellSetup(500, 0.3);
+    Gauge_SetCapacity(500);
+
+    cellCharge();
+    TEST_EQUAL(500, cellStep(0));
+}
+
+/**
+ * @brief A capacity that is set after the synchronization
+ *        keeps the state of charge.
+ */
+static void capacityKeepsCharge(void)
+{
+    uint32_t i;
+
+    cellSetup(500, 0.4);
+
+    TEST_EQUAL(0, cellRest(GAUGE_REST_TIME_s));
+    TEST_EQUAL(400, gaugeSyncSoc);
+
+    Gauge_SetCapacity(500);
+    TEST_EQUAL(200, cellStep(0));
+
+    /* The counted charge is kept over a change as well */
+    for (i = 0; i < 60; i++)
+    {
+        cellStep(CELL_CHARGE_mA);
+    }
+    Gauge_SetCapacity(1000);
+    TEST_EQUAL(400 + 60 * CELL_CHARGE_mA / 3600, cellStep(0));
+}
+
+/**
+ * @brief A charge from a low rest point learns the full capacity,
+ *        and the counted charge tracks the cell.
+ */
+static void capacityLearning(void)
+{
+    double error;
+
+    cellSetup(500, 0.2);
+    Gauge_SetCapacity(400);
+
+    cellRest(GAUGE_REST_TIME_s);
+    error = cellCharge();
+    printf("  learned %u mAh, max error %.1f mAh\n", Gauge_GetCapacity(), error);
+    TEST_CHECK((Gauge_GetCapacity() >= 490) && (Gauge_GetCapacity() <= 510));
+
+    /* The second cycle charges with the learned capacity */
+    cell.soc = 0.4;
+    cellRest(GAUGE_REST_TIME_s);
+    error = cellCharge();
+    printf("  second cycle max error %.1f mAh\n", error);
+    TEST_CHECK(error < 10);
+}
+
+/**
+ * @brief The unmeasured discharge of a charged battery is corrected
+ *        at rest, the relaxation after the charge is not.
+ */
+static void dischargeResync(void)
+{
+    cellSetup(500, 0.5);
+    Gauge_SetCapacity(500);
+
+    cellCharge();
+    cell.soc = 1 - GAUGE_RELAX_SOC / (double)GAUGE_SOC_FULL;
+    TEST_EQUAL(500, cellRest(GAUGE_REST_TIME_s * 2));
+
+    cell.soc = 0.6;
+    TEST_EQUAL(300, cellRest(GAUGE_REST_TIME_s));
+}
+
+int main(void)
+{
+    TEST_RUN(restBeforeSync);
+    TEST_RUN(fullPointSync);
+    TEST_RUN(capacityKeepsCharge);
+    TEST_RUN(capacityLearning);
+    TEST_RUN(dischargeResync);
+    return TEST_RESULT();
+}
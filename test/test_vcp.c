@@ -0,0 +1,757 @@
+/**
+  ******************************************************************************
+  * @file    test_vcp.c
+  * @author  Benedek Kupper
+  * @version 1.0
+  * @date    2026-10-16
+  * @brief   Host tests of the USB Virtual COM Port bridge
+  *
+  *  @verbatim
+  *  The VCP interface is compiled with faked UART, DMA and USB endpoints.
+  *  The test cases interleave the host transfers, the UART transfers and
+  *  the interrupts in the orders the hardware can produce them, and check
+  *  that the data passes the bridge unchanged.
+  *  @endverbatim
+  *
+  * Copyright (c) 2026 Benedek Kupper
+  *
+  * Licensed under the Apache License, Version 2.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  *     http://www.apache.org/licenses/LICENSE-2.0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  */
+#include <test.h>
+#include <stdlib.h>
+#include "../VCP/vcp_if.c"
+
+#define STREAM_SIZE             8192
+
+static VCP_HandleType vcp;
+static USART_TypeDef uartRegs;
+static DMA_Channel_TypeDef txChannel, rxChannel;
+static DMA_HandleType txDma = { .Inst = &txChannel };
+static DMA_HandleType rxDma = { .Inst = &rxChannel };
+
+static uint32_t now_us;
+static bool uartPending;
+
+/* USB OUT endpoint: the buffer armed by the device, NULL while NAKed */
+static uint8_t *outBuffer;
+static uint8_t hostOut[STREAM_SIZE];
+static uint32_t hostOutLength;
+
+/* UART Tx: the ongoing DMA transfer, and the data sent on the line */
+static uint8_t *txData;
+static uint16_t txLength;
+static uint32_t txTransfers;
+static uint8_t uartTx[STREAM_SIZE];
+static uint32_t uartTxLength;
+
+/* UART Rx: the data received on the line */
+static uint8_t uartRx[STREAM_SIZE];
+static uint32_t uartRxLength;
+
+/* USB IN endpoint: the data received by the host */
+static bool inBusy;
+static uint8_t hostIn[STREAM_SIZE];
+static uint32_t hostInLength;
+static uint32_t inTransfers;
+static uint32_t inPackets;
+
+/* Preempts the consumer when it reads the Rx DMA counter */
+static void (*dmaStatusHook)(void);
+
+/* USB notification endpoint: the reported serial state bits */
+static bool notifyBusy;
+static uint16_t notifiedState;
+static void (*notifyHook)(void);
+
+uint32_t __get_PRIMASK(void)
+{
+    return 0;
+}
+
+void __set_PRIMASK(uint32_t primask)
+{
+}
+
+void __disable_irq(void)
+{
+}
+
+uint32_t Sched_GetTime_us(void)
+{
+    return now_us;
+}
+
+void Sched_TimerStart(Sched_TimerType * Timer, uint32_t Delay_ms, uint32_t Period_ms)
+{
+    Timer->Active = 1;
+}
+
+void Sched_TimerStop(Sched_TimerType * Timer)
+{
+    Timer->Active = 0;
+}
+
+void NVIC_SetPendingIRQ(IRQn_Type IRQn)
+{
+    TEST_EQUAL(VCP_UART_IRQn, IRQn);
+    uartPending = true;
+}
+
+USBD_ReturnType USBD_CDC_Receive(USBD_CDC_IfHandleType * itf, uint8_t * data, uint16_t length)
+{
+    /* Only the self-test redirects an armed transfer */
+    TEST_CHECK((outBuffer == NULL) || (data == vcp.OutDiscard));
+    TEST_EQUAL(VCP_OUT_SEGMENT_SIZE, length);
+    outBuffer = data;
+    return USBD_E_OK;
+}
+
+USBD_ReturnType USBD_CDC_Transmit(USBD_CDC_IfHandleType * itf, uint8_t * data, uint16_t length)
+{
+    if (inBusy)
+    {
+        return USBD_E_BUSY;
+    }
+    TEST_CHECK((length > 0) && (length <= VCP_IN_DATA_SIZE));
+    if ((length > VCP_IN_DATA_SIZE) || ((hostInLength + length) > STREAM_SIZE))
+    {
+        return USBD_E_ERROR;
+    }
+    memcpy(&hostIn[hostInLength], data, length);
+    hostInLength += length;
+    inTransfers++;
+    inPackets += (length + VCP_PACKET_SIZE - 1) / VCP_PACKET_SIZE;
+    inBusy = true;
+    return USBD_E_OK;
+}
+
+USBD_ReturnType USBD_CDC_NotifySerialState(USBD_CDC_IfHandleType * itf, USBD_CDC_SerialStateType state)
+{
+    if (notifyHook != NULL)
+    {
+        void (*hook)(void) = notifyHook;
+        notifyHook = NULL;
+        hook();
+    }
+    if (notifyBusy)
+    {
+        return USBD_E_BUSY;
+    }
+    notifiedState |= state.w;
+    return USBD_E_OK;
+}
+
+void USART_vInitAsync(USART_HandleType * husart, const UART_InitType * Config)
+{
+    memset(husart->Inst, 0, sizeof(*husart->Inst));
+    husart->Inst->ISR.b.TC = 1;
+    USART_ENABLE(husart);
+}
+
+void USART_vDeinit(USART_HandleType * husart)
+{
+    USART_DISABLE(husart);
+    txData = NULL;
+}
+
+XPD_ReturnType USART_eTransmit_DMA(USART_HandleType * husart, void * Data, uint16_t Length)
+{
+    TEST_CHECK(txData == NULL);
+    TEST_CHECK(Length > 0);
+    txData = Data;
+    txLength = Length;
+    txTransfers++;
+    husart->Inst->ISR.b.TC = 0;
+    return XPD_OK;
+}
+
+XPD_ReturnType USART_eReceive_DMA(USART_HandleType * husart, void * Data, uint16_t Length)
+{
+    husart->DMA.Receive->Inst->CNDTR = Length;
+    husart->DMA.Receive->Inst->TC = 0;
+    return XPD_OK;
+}
+
+void USART_vIRQHandler(USART_HandleType * husart)
+{
+}
+
+uint32_t USART_ulClockFreq_Hz(USART_HandleType * husart)
+{
+    return 48000000;
+}
+
+uint16_t DMA_usGetStatus(DMA_HandleType * hdma)
+{
+    if (dmaStatusHook != NULL)
+    {
+        void (*hook)(void) = dmaStatusHook;
+        dmaStatusHook = NULL;
+        hook();
+    }
+    return hdma->Inst->CNDTR;
+}
+
+void DMA_vStop(DMA_HandleType * hdma)
+{
+}
+
+/* Runs the pending UART interrupt */
+static void uartIrq(void)
+{
+    while (uartPending)
+    {
+        uartPending = false;
+        VCP_IRQHandler(&vcp);
+    }
+}
+
+/* Opens the port with 8N1 line coding */
+static void vcpSetup(void)
+{
+    memset(&vcp, 0, sizeof(vcp));
+    memset(&uartRegs, 0, sizeof(uartRegs));
+    vcp.Uart.Inst = &uartRegs;
+    vcp.Uart.DMA.Transmit = &txDma;
+    vcp.Uart.DMA.Receive = &rxDma;
+    rxDma.Owner = &vcp.Uart;
+
+    now_us = 0;
+    uartPending = false;
+    outBuffer = NULL;
+    hostOutLength = 0;
+    txData = NULL;
+    txTransfers = 0;
+    uartTxLength = 0;
+    uartRxLength = 0;
+    inBusy = false;
+    hostInLength = 0;
+    inTransfers = 0;
+    inPackets = 0;
+    dmaStatusHook = NULL;
+
+    vcp.CdcIf.LineCoding.DTERate = 115200;
+    vcp.CdcIf.LineCoding.DataBits = 8;
+    vcpApp.Open(&vcp.CdcIf, &vcp.CdcIf.LineCoding);
+}
+
+/* The host sends an OUT packet into the armed segment */
+static void hostSend(uint16_t length)
+{
+    uint8_t *buffer = outBuffer;
+    uint16_t i;
+
+    TEST_CHECK(buffer != NULL);
+    outBuffer = NULL;
+    for (i = 0; i < length; i++)
+    {
+        buffer[i] = (uint8_t)(hostOutLength * 7 + 3);
+        hostOut[hostOutLength++] = buffer[i];
+    }
+    vcpApp.Received(&vcp.CdcIf, buffer, length);
+    uartIrq();
+}
+
+/* The UART Tx DMA completes the ongoing transfer */
+static void uartTransmitted(void)
+{
+    TEST_CHECK(txData != NULL);
+    memcpy(&uartTx[uartTxLength], txData, txLength);
+    uartTxLength += txLength;
+    txData = NULL;
+    uartRegs.ISR.b.TC = 1;
+    vcp.Uart.Callbacks.Transmit(&vcp.Uart);
+    uartIrq();
+}
+
+/* The Rx DMA signals that it has wrapped */
+static void rxDmaComplete(void)
+{
+    rxChannel.TC = 0;
+    vcp.Uart.Callbacks.Receive(&vcp.Uart);
+}
+
+/* The UART receives bytes into the circular buffer by DMA, the flush
+ * requested by the DMA interrupts is left pending for the caller,
+ * the transfer complete interrupt itself is optionally left pending */
+static void uartReceive(uint16_t length, bool deferWrap)
+{
+    for (; length > 0; length--)
+    {
+        uint8_t byte = (uint8_t)(uartRxLength * 13 + 5);
+
+        uartRx[uartRxLength++] = byte;
+        vcp.InData[VCP_IN_DATA_SIZE - rxChannel.CNDTR] = byte;
+
+        if (--rxChannel.CNDTR == (VCP_IN_DATA_SIZE / 2))
+        {
+            rxDma.Callbacks.HalfComplete(&rxDma);
+        }
+        else if (rxChannel.CNDTR == 0)
+        {
+            rxChannel.CNDTR = VCP_IN_DATA_SIZE;
+            rxChannel.TC = 1;
+            if (!deferWrap)
+            {
+                rxDmaComplete();
+            }
+        }
+    }
+}
+
+/* The UART line becomes idle */
+static void uartIdle(void)
+{
+    uartRegs.ISR.b.IDLE = 1;
+    uartPending = true;
+    uartIrq();
+}
+
+/* The host completes the ongoing IN transfer */
+static void hostReceived(void)
+{
+    TEST_CHECK(inBusy);
+    inBusy = false;
+    vcpApp.Transmitted(&vcp.CdcIf, NULL, 0);
+    uartIrq();
+}
+
+/**
+ * @brief OUT packets of random length arrive in random order with the UART
+ *        Tx completions, the UART transmits the same stream as the host sent,
+ *        and the endpoint is only NAKed while all segments are occupied.
+ */
+static void segmentQueueInterleaving(void)
+{
+    uint32_t step;
+
+    vcpSetup();
+    srand(1);
+
+    for (step = 0; step < 4000; step++)
+    {
+        if ((outBuffer != NULL) && ((rand() % 3) != 0) &&
+            (hostOutLength < (STREAM_SIZE - VCP_OUT_SEGMENT_SIZE)))
+        {
+            /* Bulk transfers consist mostly of full packets */
+            hostSend(((rand() % 4) != 0) ? VCP_OUT_SEGMENT_SIZE : (1 + rand() % VCP_OUT_SEGMENT_SIZE));
+        }
+        else if (txData != NULL)
+        {
+            uartTransmitted();
+        }
+
+        TEST_EQUAL(vcp.OutCount < VCP_OUT_SEGMENT_COUNT, outBuffer != NULL);
+        TEST_EQUAL(vcp.OutCount > 0, txData != NULL);
+    }
+    while (txData != NULL)
+    {
+        uartTransmitted();
+    }
+
+    TEST_EQUAL(hostOutLength, uartTxLength);
+    TEST_CHECK(memcmp(hostOut, uartTx, hostOutLength) == 0);
+    TEST_EQUAL(0, vcp.OutCount);
+    TEST_EQUAL(hostOutLength, vcp.Stats.OutBytes);
+}
+
+/**
+ * @brief Full segments queued while the UART is busy are transmitted
+ *        in a single transfer up to the end of the segment ring,
+ *        and a full queue resumes reception as soon as one is released.
+ */
+static void segmentQueueChaining(void)
+{
+    vcpSetup();
+
+    hostSend(VCP_OUT_SEGMENT_SIZE);
+    TEST_EQUAL(1, txTransfers);
+    TEST_EQUAL(VCP_OUT_SEGMENT_SIZE, txLength);
+
+    /* Fill the queue while the first segment is transmitted */
+    hostSend(VCP_OUT_SEGMENT_SIZE);
+    hostSend(VCP_OUT_SEGMENT_SIZE);
+    hostSend(VCP_OUT_SEGMENT_SIZE);
+    TEST_CHECK(outBuffer == NULL);
+
+    /* The remaining segments are chained */
+    uartTransmitted();
+    TEST_CHECK(outBuffer == vcp.OutData[0]);
+    TEST_EQUAL(2, txTransfers);
+    TEST_EQUAL((VCP_OUT_SEGMENT_COUNT - 1) * VCP_OUT_SEGMENT_SIZE, txLength);
+
+    /* A short packet is not chained with the following segments */
+    hostSend(10);
+    TEST_CHECK(outBuffer == NULL);
+    uartTransmitted();
+    TEST_EQUAL(3, txTransfers);
+    TEST_EQUAL(10, txLength);
+    hostSend(VCP_OUT_SEGMENT_SIZE);
+    uartTransmitted();
+    TEST_EQUAL(4, txTransfers);
+    TEST_EQUAL(VCP_OUT_SEGMENT_SIZE, txLength);
+    uartTransmitted();
+
+    TEST_EQUAL(hostOutLength, uartTxLength);
+    TEST_CHECK(memcmp(hostOut, uartTx, hostOutLength) == 0);
+}
+
+/**
+ * @brief A burst flushed at once from any position of the circular buffer
+ *        is sent in the least number of IN packets, also when it wraps around.
+ *        The average packet size of continuous reception is reported.
+ */
+static void inPacketBenchmark(void)
+{
+    static const uint16_t bursts[] = { 1, 10, 63, 64, 65, 100, 127, 128 };
+    uint32_t step, offset;
+    uint8_t i;
+
+    for (i = 0; i < sizeof(bursts) / sizeof(bursts[0]); i++)
+    {
+        for (offset = 0; offset < VCP_IN_DATA_SIZE; offset++)
+        {
+            uint32_t packets;
+
+            vcpSetup();
+
+            /* Move the buffer position */
+            if (offset > 0)
+            {
+                uartReceive(offset, false);
+                uartIdle();
+                while (inBusy)
+                {
+                    hostReceived();
+                }
+            }
+            packets = inPackets;
+
+            uartReceive(bursts[i], false);
+            uartIdle();
+            while (inBusy)
+            {
+                hostReceived();
+            }
+
+            TEST_EQUAL((bursts[i] + VCP_PACKET_SIZE - 1) / VCP_PACKET_SIZE, inPackets - packets);
+            TEST_EQUAL(uartRxLength, hostInLength);
+            TEST_CHECK(memcmp(uartRx, hostIn, uartRxLength) == 0);
+        }
+    }
+
+    /* Continuous reception, the host polls the IN endpoint once per chunk */
+    vcpSetup();
+    srand(3);
+    for (step = 0; uartRxLength < (STREAM_SIZE - VCP_IN_DATA_SIZE); step++)
+    {
+        uartReceive(1 + rand() % (VCP_IN_DATA_SIZE / 2), false);
+        uartIrq();
+        if (inBusy)
+        {
+            hostReceived();
+        }
+    }
+    uartIdle();
+    while (inBusy)
+    {
+        hostReceived();
+    }
+
+    TEST_EQUAL(uartRxLength, hostInLength);
+    TEST_CHECK(memcmp(uartRx, hostIn, uartRxLength) == 0);
+    TEST_EQUAL(0, vcp.RxErrors.Dropped);
+    printf("  continuous: %u bytes in %u transfers, %u packets, %u bytes/packet\n",
+           (unsigned)hostInLength, (unsigned)inTransfers, (unsigned)inPackets,
+           (unsigned)(hostInLength / inPackets));
+}
+
+/**
+ * @brief OUT data arriving during the PRBS self-test is not mixed into the
+ *        test stream, and the bridge operation resumes after the test.
+ */
+static void prbsTestIgnoresOut(void)
+{
+    static uint8_t source[VCP_OUT_SEGMENT_COUNT * VCP_OUT_SEGMENT_SIZE];
+    uint32_t transfers;
+
+    vcpSetup();
+    hostSend(VCP_OUT_SEGMENT_SIZE);
+    uartTransmitted();
+
+    VCP_StartTest(&vcp, VCP_TEST_PRBS, 115200, 1000);
+    TEST_CHECK(txData != NULL);
+    transfers = txTransfers;
+    memcpy(source, vcp.OutData, sizeof(source));
+
+    /* The transfer armed before the test is discarded, then NAKed,
+     * its data doesn't overwrite the PRBS stream */
+    TEST_CHECK(outBuffer == vcp.OutDiscard);
+    hostSend(VCP_OUT_SEGMENT_SIZE);
+    TEST_CHECK(outBuffer == NULL);
+    TEST_EQUAL(transfers, txTransfers);
+    TEST_EQUAL(0, vcp.OutCount);
+    TEST_CHECK(memcmp(source, vcp.OutData, sizeof(source)) == 0);
+
+    /* The stream continues with the other half of the segments */
+    uartTransmitted();
+    TEST_EQUAL(transfers + 1, txTransfers);
+    TEST_CHECK(txData == vcp.OutData[VCP_OUT_SEGMENT_COUNT / 2]);
+
+    VCP_StopTest(&vcp);
+    TEST_CHECK(outBuffer == vcp.OutData[0]);
+    uartTxLength = 0;
+    hostOutLength = 0;
+    hostSend(10);
+    uartTransmitted();
+    TEST_EQUAL(10, uartTxLength);
+    TEST_CHECK(memcmp(hostOut, uartTx, uartTxLength) == 0);
+}
+
+/**
+ * @brief The divider of the standard and some odd baudrates at 48 MHz,
+ *        the clamping of the out of range requests, and the rejection
+ *        of the requests that cannot be met within the tolerance.
+ */
+static void baudrateTable(void)
+{
+    static const struct {
+        uint32_t request;
+        uint32_t achieved;  /* 0 if rejected */
+        uint16_t brr;
+    }table[] = {
+        {      300,     733, 0xFFCC }, /* clamped to the 16 bit divider */
+        {     1200,    1200, 0x9C40 },
+        {     9600,    9600, 0x1388 },
+        {    19200,   19200, 0x09C4 },
+        {    31250,   31250, 0x0600 }, /* MIDI */
+        {    38400,   38400, 0x04E2 },
+        {    57600,   57623, 0x0341 },
+        {    74880,   74883, 0x0281 }, /* ESP8266 boot log */
+        {   115200,  115108, 0x01A1 },
+        {   230400,  230769, 0x00D0 },
+        {   250000,  250000, 0x00C0 }, /* DMX512 */
+        {   460800,  461538, 0x0068 },
+        {   921600,  923077, 0x0034 },
+        {  1000000, 1000000, 0x0030 },
+        {  2000000, 2000000, 0x0018 },
+        {  3000000, 3000000, 0x0010 }, /* the last with 16x oversampling */
+        {  3100000, 3096774, 0x0017 }, /* 8x oversampling, USARTDIV 31 */
+        {  3500000, 3555556, 0x0015 }, /* half step, USARTDIV 27 */
+        {  4000000, 4000000, 0x0014 },
+        {  4500000, 4571429, 0x0012 }, /* half step, USARTDIV 21 */
+        {  5000000, 5052632, 0x0011 }, /* half step, USARTDIV 19 */
+        {  5500000,       0, 0      }, /* 2.67 % error */
+        {  6000000, 6000000, 0x0010 },
+        { 12000000, 6000000, 0x0010 }, /* clamped to clock / 8 */
+    };
+    uint8_t i;
+
+    for (i = 0; i < sizeof(table) / sizeof(table[0]); i++)
+    {
+        uint16_t brr = 0;
+        uint32_t achieved = VCP_CalcBaudrate(48000000, table[i].request, &brr);
+
+        TEST_EQUAL(table[i].achieved, achieved);
+        if (table[i].achieved != 0)
+        {
+            TEST_EQUAL(table[i].brr, brr);
+        }
+    }
+
+    /* A rejected request keeps the previous baudrate of the port */
+    vcpSetup();
+    vcp.CdcIf.LineCoding.DTERate = 5500000;
+    VCP_Close(&vcp.CdcIf);
+    outBuffer = NULL;
+    vcpApp.Open(&vcp.CdcIf, &vcp.CdcIf.LineCoding);
+    TEST_EQUAL(115108, vcp.CdcIf.LineCoding.DTERate);
+    TEST_EQUAL(0x01A1, uartRegs.BRR.w);
+}
+
+/* A framing error is received while the endpoint is busy */
+static void framingErrorWhileBusy(void)
+{
+    notifyBusy = true;
+    uartRegs.ISR.b.FE = 1;
+    VCP_IRQHandler(&vcp);
+    notifyBusy = false;
+}
+
+/**
+ * @brief Each reception error is notified once, the errors that occur
+ *        while a notification is rejected or in progress are kept.
+ */
+static void serialStateRetry(void)
+{
+    vcpSetup();
+    notifiedState = 0;
+
+    notifyBusy = true;
+    uartRegs.ISR.b.ORE = 1;
+    VCP_IRQHandler(&vcp);
+    TEST_EQUAL(0, uartRegs.ISR.b.ORE);
+    TEST_EQUAL(0, notifiedState);
+    TEST_EQUAL(1, vcp.SerialState.b.OverRun);
+    TEST_EQUAL(1, vcp.RetryTimer.Active);
+
+    /* The retry is preempted by a new error */
+    notifyBusy = false;
+    notifyHook = framingErrorWhileBusy;
+    VCP_Retry(&vcp);
+    TEST_EQUAL(0x40, notifiedState);
+    TEST_EQUAL(0x10, vcp.SerialState.w);
+
+    VCP_Retry(&vcp);
+    TEST_EQUAL(0x50, notifiedState);
+    TEST_EQUAL(0, vcp.SerialState.w);
+}
+
+/* Reception with its wrap interrupt preempts the consumer */
+static void preemptByWrap(void)
+{
+    uartReceive(rxChannel.CNDTR + 3, false);
+}
+
+/**
+ * @brief The consumer flushes while the wrap of the Rx DMA is only
+ *        signalled by the transfer complete flag, its interrupt runs later.
+ */
+static void rxRingDeferredWrap(void)
+{
+    vcpSetup();
+
+    uartReceive(100, false);
+    uartIdle();
+    hostReceived();
+    TEST_CHECK(!inBusy);
+
+    uartReceive(40, true);
+    TEST_EQUAL(1, rxChannel.TC);
+    uartIdle();
+    hostReceived();
+    rxDmaComplete();
+    uartIrq();
+
+    TEST_CHECK(!inBusy);
+    TEST_EQUAL(uartRxLength, hostInLength);
+    TEST_CHECK(memcmp(uartRx, hostIn, uartRxLength) == 0);
+    TEST_EQUAL(0, vcp.RxErrors.Dropped);
+}
+
+/**
+ * @brief The wrap interrupt preempts the consumer while it takes
+ *        the snapshot of the producer position.
+ */
+static void rxRingPreemptedSnapshot(void)
+{
+    vcpSetup();
+
+    uartReceive(100, false);
+    uartIdle();
+    hostReceived();
+
+    dmaStatusHook = preemptByWrap;
+    uartIdle();
+    while (inBusy)
+    {
+        hostReceived();
+    }
+
+    TEST_CHECK(dmaStatusHook == NULL);
+    TEST_EQUAL(uartRxLength, hostInLength);
+    TEST_CHECK(memcmp(uartRx, hostIn, uartRxLength) == 0);
+    TEST_EQUAL(0, vcp.RxErrors.Dropped);
+}
+
+/**
+ * @brief Random interleaving of the Rx DMA progress, its deferred
+ *        interrupts, the flush requests and the host IN polling.
+ *        As long as the host keeps up, no data is lost or reordered.
+ */
+static void rxRingInterleaving(void)
+{
+    uint32_t step;
+    bool wrapDeferred = false;
+
+    vcpSetup();
+    srand(7);
+
+    for (step = 0; uartRxLength < (STREAM_SIZE - VCP_IN_DATA_SIZE); step++)
+    {
+        uint32_t space = VCP_IN_DATA_SIZE - (uartRxLength - hostInLength);
+
+        switch (rand() % 4)
+        {
+            case 0:
+                if (space > 0)
+                {
+                    uint16_t length = 1 + rand() % (VCP_IN_DATA_SIZE / 4);
+                    uartReceive((length < space) ? length : space, (rand() % 2) != 0);
+                }
+                break;
+            case 1:
+                uartIdle();
+                break;
+            case 2:
+                if (inBusy)
+                {
+                    hostReceived();
+                }
+                break;
+            default:
+                if ((rxChannel.TC == 0) && (space > (rxChannel.CNDTR + 3)))
+                {
+                    dmaStatusHook = preemptByWrap;
+                }
+                uartIdle();
+                dmaStatusHook = NULL;
+                break;
+        }
+
+        /* The wrap interrupt is served before the DMA reaches the half */
+        if (wrapDeferred && (rxChannel.TC != 0))
+        {
+            rxDmaComplete();
+        }
+        wrapDeferred = rxChannel.TC != 0;
+        uartIrq();
+    }
+    if (rxChannel.TC != 0)
+    {
+        rxDmaComplete();
+    }
+    uartIdle();
+    while (inBusy)
+    {
+        hostReceived();
+    }
+
+    TEST_EQUAL(uartRxLength, hostInLength);
+    TEST_CHECK(memcmp(uartRx, hostIn, uartRxLength) == 0);
+    TEST_EQUAL(0, vcp.RxErrors.Dropped);
+}
+
+int main(void)
+{
+    TEST_RUN(segmentQueueInterleaving);
+    TEST_RUN(segmentQueueChaining);
+    TEST_RUN(inPacketBenchmark);
+    TEST_RUN(prbsTestIgnoresOut);
+    TEST_RUN(baudrateTable);
+    TEST_RUN(serialStateRetry);
+    TEST_RUN(rxRingDeferredWrap);
+    TEST_RUN(rxRingPreemptedSnapshot);
+    TEST_RUN(rxRingInterleaving);
+    return TEST_RESULT();
+}